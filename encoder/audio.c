@@ -0,0 +1,328 @@
+/*
+ *  Morse audio synthesis
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "audio.h"
+#include "morse_timing.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define PI			3.14159265358979323846
+
+/* Peak amplitude of the tone */
+#define TONE_AMPLITUDE		(0.8 * 32767)
+/* Length of the raised cosine attack and release, in milliseconds */
+#define TONE_RAMP_MS		5
+
+static void put_le16(char *buf, int16_t value)
+{
+	buf[0] = (char)(value & 0xFF);
+	buf[1] = (char)((value >> 8) & 0xFF);
+}
+
+static void put_le32(char *buf, uint32_t value)
+{
+	buf[0] = (char)(value & 0xFF);
+	buf[1] = (char)((value >> 8) & 0xFF);
+	buf[2] = (char)((value >> 16) & 0xFF);
+	buf[3] = (char)((value >> 24) & 0xFF);
+}
+
+/* Render a tone with raised cosine shaped edges.
+ * The edges start and end at zero, so the blocks can be
+ * concatenated without clicks. */
+static char * render_tone(size_t nr_samples, unsigned int rate,
+			  unsigned int freq)
+{
+	size_t i, ramp;
+	double env;
+	char *buf;
+
+	buf = malloc(nr_samples * 2);
+	if (!buf)
+		return NULL;
+
+	ramp = (size_t)rate * TONE_RAMP_MS / 1000;
+	if (ramp > nr_samples / 2)
+		ramp = nr_samples / 2;
+
+	for (i = 0; i < nr_samples; i++) {
+		if (i < ramp)
+			env = 0.5 - 0.5 * cos(PI * (double)i / (double)ramp);
+		else if (i >= nr_samples - ramp)
+			env = 0.5 - 0.5 * cos(PI * (double)(nr_samples - 1 - i) / (double)ramp);
+		else
+			env = 1.0;
+		put_le16(&buf[i * 2], (int16_t)lrint(TONE_AMPLITUDE * env *
+				sin(2.0 * PI * (double)freq * (double)i / (double)rate)));
+	}
+
+	return buf;
+}
+
+/* Render the waveform blocks for a speed in words per minute. */
+int tone_blocks_init(struct tone_blocks *t, unsigned int rate,
+		     unsigned int freq, unsigned int wpm)
+{
+	size_t dit_samples;
+
+	memset(t, 0, sizeof(*t));
+
+	dit_samples = (size_t)((uint64_t)rate * DIT_LENGTH_1WPM_MS / 1000 / wpm);
+	if (!dit_samples)
+		return -1;
+
+	t->dit_size = dit_samples * FACTOR_DIT * 2;
+	t->dit = render_tone(dit_samples * FACTOR_DIT, rate, freq);
+	t->dah_size = dit_samples * FACTOR_DAH * 2;
+	t->dah = render_tone(dit_samples * FACTOR_DAH, rate, freq);
+	t->gap_size = dit_samples * 2;
+	t->gap = calloc(1, t->gap_size);
+	if (!t->dit || !t->dah || !t->gap) {
+		tone_blocks_free(t);
+		return -1;
+	}
+
+	return 0;
+}
+
+void tone_blocks_free(struct tone_blocks *t)
+{
+	free(t->dit);
+	free(t->dah);
+	free(t->gap);
+	memset(t, 0, sizeof(*t));
+}
+
+/* Build a WAV header for 16 bit mono PCM.
+ * hdr must be WAV_HEADER_SIZE bytes. */
+void wav_header(char *hdr, unsigned int rate, uint32_t data_size)
+{
+	memcpy(&hdr[0], "RIFF", 4);
+	put_le32(&hdr[4], data_size > UINT32_MAX - 36 ? UINT32_MAX
+						      : data_size + 36);
+	memcpy(&hdr[8], "WAVE", 4);
+	memcpy(&hdr[12], "fmt ", 4);
+	put_le32(&hdr[16], 16);		/* fmt chunk size */
+	put_le16(&hdr[20], 1);		/* PCM */
+	put_le16(&hdr[22], 1);		/* Mono */
+	put_le32(&hdr[24], rate);
+	put_le32(&hdr[28], rate * 2);	/* Byte rate */
+	put_le16(&hdr[32], 2);		/* Block align */
+	put_le16(&hdr[34], 16);		/* Bits per sample */
+	memcpy(&hdr[36], "data", 4);
+	put_le32(&hdr[40], data_size);
+}
+
+static uint32_t get_le32(const char *buf)
+{
+	return (uint32_t)get_le16(buf) | (uint32_t)get_le16(&buf[2]) << 16;
+}
+
+void wav_reader_init(struct wav_reader *w)
+{
+	memset(w, 0, sizeof(*w));
+	w->state = WAV_RIFF;
+	w->need = 12;
+}
+
+/* Parse WAV headers up to the start of the sample data.
+ * *consumed is set to the number of header bytes used from buf.
+ * Everything after that is sample data, if the state is WAV_DATA.
+ * Only 16 bit mono PCM is supported.
+ * Returns 0 on success or -1 on a malformed or unsupported file.
+ */
+int wav_reader_parse(struct wav_reader *w, const char *buf, size_t len,
+		     size_t *consumed)
+{
+	size_t count, pos = 0;
+
+	while (pos < len && w->state != WAV_DATA) {
+		if (w->state == WAV_SKIP) {
+			count = min((size_t)w->left, len - pos);
+			pos += count;
+			w->left -= (uint32_t)count;
+			if (!w->left) {
+				w->state = WAV_CHUNK;
+				w->need = 8;
+			}
+			continue;
+		}
+
+		count = min(w->need - w->len, len - pos);
+		memcpy(&w->buf[w->len], &buf[pos], count);
+		w->len += count;
+		pos += count;
+		if (w->len < w->need)
+			break;
+		w->len = 0;
+
+		switch (w->state) {
+		case WAV_RIFF:
+			if (memcmp(&w->buf[0], "RIFF", 4) ||
+			    memcmp(&w->buf[8], "WAVE", 4))
+				return -1;
+			w->state = WAV_CHUNK;
+			w->need = 8;
+			break;
+		case WAV_CHUNK:
+			w->left = get_le32(&w->buf[4]);
+			if (!memcmp(&w->buf[0], "data", 4)) {
+				if (!w->have_fmt)
+					return -1;
+				w->state = WAV_DATA;
+			} else if (!memcmp(&w->buf[0], "fmt ", 4) &&
+				   w->left >= 16 && w->left <= sizeof(w->buf)) {
+				w->state = WAV_FMT;
+				w->need = w->left;
+			} else {
+				/* Chunks are padded to even size. */
+				w->left += w->left & 1;
+				w->state = w->left ? WAV_SKIP : WAV_CHUNK;
+				w->need = 8;
+			}
+			break;
+		case WAV_FMT:
+			if (get_le16(&w->buf[0]) != 1 ||	/* PCM */
+			    get_le16(&w->buf[2]) != 1 ||	/* Mono */
+			    get_le16(&w->buf[14]) != 16)	/* 16 bit */
+				return -1;
+			w->rate = get_le32(&w->buf[4]);
+			if (!w->rate)
+				return -1;
+			w->have_fmt = true;
+			w->left += w->left & 1;
+			w->left -= (uint32_t)w->need;
+			w->state = w->left ? WAV_SKIP : WAV_CHUNK;
+			w->need = 8;
+			break;
+		case WAV_SKIP:
+		case WAV_DATA:
+			break;
+		}
+	}
+	*consumed = pos;
+
+	return 0;
+}
+
+/* Required ratio of the signal and noise levels */
+#define TONE_MIN_SNR		300.0
+/* Hysteresis around the decision threshold, as power ratio */
+#define TONE_HYSTERESIS		2.0
+
+void tone_detector_init(struct tone_detector *d, unsigned int rate,
+			unsigned int freq, unsigned int block_len)
+{
+	memset(d, 0, sizeof(*d));
+	d->block_len = block_len;
+	d->coeff = 2.0 * cos(2.0 * PI * (double)freq / (double)rate);
+}
+
+/* Make the key decision for the oldest undecided block.
+ * The signal level is the strongest block in the window around it.
+ * The noise level is a low percentile. Even dense Morse code keeps the
+ * key up for a good part of the time, so that is a gap. The powers
+ * of noise blocks scatter a lot, so the minimum would be no good level.
+ */
+static void tone_detector_decide(struct tone_detector *d)
+{
+	double sorted[TONE_WINDOW], power, signal, noise, threshold;
+	unsigned int i, j, count;
+	unsigned long first;
+
+	first = d->nr_blocks > TONE_WINDOW ? d->nr_blocks - TONE_WINDOW : 0;
+	count = (unsigned int)(d->nr_blocks - first);
+	for (i = 0; i < count; i++) {
+		power = d->power[(first + i) % TONE_WINDOW];
+		for (j = i; j > 0 && sorted[j - 1] > power; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = power;
+	}
+	signal = sorted[count - 1];
+	noise = sorted[count / 16];
+
+	power = d->power[d->nr_decided % TONE_WINDOW];
+	d->nr_decided++;
+
+	if (signal < noise * TONE_MIN_SNR) {
+		d->key = false; /* Noise only */
+		return;
+	}
+	/* Threshold at the geometric mean of the levels */
+	threshold = sqrt(signal * noise);
+	if (d->key)
+		d->key = power > threshold / TONE_HYSTERESIS;
+	else
+		d->key = power > threshold * TONE_HYSTERESIS;
+}
+
+/* Feed 16 bit little endian samples into the detector.
+ * Processing stops after a block, if that made a decision available.
+ * *decided is set then and d->key holds the decision.
+ * Returns the number of samples consumed.
+ */
+size_t tone_detector_run(struct tone_detector *d, const char *pcm,
+			 size_t nr_samples, bool *decided)
+{
+	double s0, s1 = d->s1, s2 = d->s2, power;
+	size_t i, count;
+
+	count = min((size_t)(d->block_len - d->pos), nr_samples);
+	for (i = 0; i < count; i++) {
+		s0 = (double)(int16_t)get_le16(&pcm[i * 2]) + d->coeff * s1 - s2;
+		s2 = s1;
+		s1 = s0;
+	}
+	d->pos += (unsigned int)count;
+	*decided = false;
+
+	if (d->pos == d->block_len) {
+		power = s1 * s1 + s2 * s2 - d->coeff * s1 * s2;
+		power /= (double)d->block_len * (double)d->block_len;
+		/* Keep the levels above zero for digital silence. */
+		d->power[d->nr_blocks % TONE_WINDOW] = power + 1.0;
+		d->nr_blocks++;
+		d->pos = 0;
+		s1 = s2 = 0.0;
+
+		if (d->nr_blocks - d->nr_decided > TONE_WINDOW / 2) {
+			tone_detector_decide(d);
+			*decided = true;
+		}
+	}
+	d->s1 = s1;
+	d->s2 = s2;
+
+	return count;
+}
+
+/* Decide the remaining blocks at the end of the input.
+ * Returns true, if a decision was made. d->key holds it then. */
+bool tone_detector_flush(struct tone_detector *d)
+{
+	if (d->nr_decided == d->nr_blocks)
+		return false;
+	tone_detector_decide(d);
+
+	return true;
+}
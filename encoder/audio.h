@@ -0,0 +1,94 @@
+#ifndef AUDIO_H_
+#define AUDIO_H_
+
+#include "util.h"
+
+#include <stddef.h>
+
+
+static inline uint16_t get_le16(const char *buf)
+{
+	return (uint16_t)((uint8_t)buf[0] | (uint8_t)buf[1] << 8);
+}
+
+/* Size of a WAV file header */
+#define WAV_HEADER_SIZE		44
+
+/* Pre-rendered waveform blocks.
+ * Signed 16 bit little endian mono PCM. */
+struct tone_blocks {
+	/* A "dit" tone */
+	char *dit;
+	size_t dit_size;
+	/* A "dah" tone */
+	char *dah;
+	size_t dah_size;
+	/* Silence of the length of one "dit" */
+	char *gap;
+	size_t gap_size;
+};
+
+int tone_blocks_init(struct tone_blocks *t, unsigned int rate,
+		     unsigned int freq, unsigned int wpm);
+void tone_blocks_free(struct tone_blocks *t);
+
+void wav_header(char *hdr, unsigned int rate, uint32_t data_size);
+
+
+enum wav_reader_state {
+	WAV_RIFF,		/* Reading the RIFF header */
+	WAV_CHUNK,		/* Reading a chunk header */
+	WAV_FMT,		/* Reading the format chunk */
+	WAV_SKIP,		/* Skipping an unknown chunk */
+	WAV_DATA,		/* In the sample data */
+};
+
+/* Streaming WAV header parser */
+struct wav_reader {
+	enum wav_reader_state state;
+	char buf[40];
+	size_t len;
+	size_t need;
+	/* Bytes left in the current chunk */
+	uint32_t left;
+	/* Sample rate from the format chunk */
+	unsigned int rate;
+	bool have_fmt;
+};
+
+void wav_reader_init(struct wav_reader *w);
+int wav_reader_parse(struct wav_reader *w, const char *buf, size_t len,
+		     size_t *consumed);
+
+
+/* Length of the tone detector level window, in blocks */
+#define TONE_WINDOW		64
+
+/* Goertzel tone detector with automatic gain control.
+ * The samples are analyzed in blocks. Every block results in one
+ * key decision (tone present or not). The decision threshold adapts
+ * to the signal and noise levels in a window around the block, so
+ * decisions are delayed by TONE_WINDOW / 2 blocks.
+ */
+struct tone_detector {
+	unsigned int block_len;
+	double coeff;
+	/* Goertzel state */
+	unsigned int pos;
+	double s1, s2;
+	/* Ring of block powers */
+	double power[TONE_WINDOW];
+	/* Number of blocks analyzed and decided */
+	unsigned long nr_blocks;
+	unsigned long nr_decided;
+	/* The last key decision */
+	bool key;
+};
+
+void tone_detector_init(struct tone_detector *d, unsigned int rate,
+			unsigned int freq, unsigned int block_len);
+size_t tone_detector_run(struct tone_detector *d, const char *pcm,
+			 size_t nr_samples, bool *decided);
+bool tone_detector_flush(struct tone_detector *d);
+
+#endif /* AUDIO_H_ */
@@ -0,0 +1,483 @@
+/*
+ *  Morse encoder batch mode
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "batch.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+
+/* Size of the input and output blocks. Page aligned. */
+#define BATCH_BLOCK_SIZE	(1024 * 1024)
+#define BATCH_BLOCK_ALIGN	4096
+
+struct batch_file {
+	char *path;
+	off_t size;
+	/* Identity of the file. A file is converted only once,
+	 * even if it is reached by several paths. */
+	dev_t dev;
+	ino_t ino;
+};
+
+/* The files of one worker.
+ * The files are sorted by size and dealt out round robin, so queue q
+ * holds the files q + k * nr_queues for k from head to tail. The owner
+ * takes the largest file from the head. Idle workers steal the smallest
+ * file from the tail, so a few huge files do not hold up the rest.
+ */
+struct batch_queue {
+	pthread_mutex_t lock;
+	size_t head;
+	size_t tail;
+};
+
+struct batch {
+	enum morse_format format;
+	unsigned int flags;
+	struct batch_file *files;
+	size_t nr_files;
+	size_t files_size;
+	struct batch_queue *queues;
+	unsigned int nr_queues;
+};
+
+struct batch_worker {
+	struct batch *b;
+	unsigned int index;
+	pthread_t thread;
+	char *in;
+	char *out;
+	size_t out_len;
+	int out_fd;
+	/* Some file failed */
+	bool failed;
+};
+
+
+static bool has_suffix(const char *name, const char *suffix)
+{
+	size_t len = strlen(name), slen = strlen(suffix);
+
+	return len > slen && !strcmp(&name[len - slen], suffix);
+}
+
+/* Whether a file found in a directory is converted */
+static bool batch_takes(const struct batch *b, const char *name)
+{
+	if (b->flags & MORSE_DECODE)
+		return has_suffix(name, BATCH_SUFFIX);
+	return !has_suffix(name, BATCH_SUFFIX) &&
+	       !has_suffix(name, BATCH_SUFFIX BATCH_DECODED_SUFFIX);
+}
+
+static char * path_join(const char *a, const char *b)
+{
+	char *path;
+
+	path = malloc(strlen(a) + strlen(b) + 2);
+	if (path)
+		sprintf(path, "%s/%s", a, b);
+
+	return path;
+}
+
+static int batch_add(struct batch *b, char *path, const struct stat *st)
+{
+	struct batch_file *files;
+
+	if (b->nr_files == b->files_size) {
+		b->files_size = max(b->files_size * 2, (size_t)64);
+		files = realloc(b->files, b->files_size * sizeof(*files));
+		if (!files) {
+			fprintf(stderr, "Out of memory\n");
+			free(path);
+			return -1;
+		}
+		b->files = files;
+	}
+	b->files[b->nr_files].path = path;
+	b->files[b->nr_files].size = st->st_size;
+	b->files[b->nr_files].dev = st->st_dev;
+	b->files[b->nr_files].ino = st->st_ino;
+	b->nr_files++;
+
+	return 0;
+}
+
+/* Collect the files below a directory.
+ * Symbolic links to directories are not followed. */
+static int batch_walk(struct batch *b, const char *dir_path)
+{
+	DIR *dir;
+	struct dirent *d;
+	struct stat st;
+	char *path;
+	int err = 0;
+
+	dir = opendir(dir_path);
+	if (!dir) {
+		fprintf(stderr, "%s: %s\n", dir_path, strerror(errno));
+		return -1;
+	}
+	while (!err && (d = readdir(dir))) {
+		if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+			continue;
+		path = path_join(dir_path, d->d_name);
+		if (!path) {
+			fprintf(stderr, "Out of memory\n");
+			err = -1;
+			break;
+		}
+		if (lstat(path, &st)) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			free(path);
+			err = -1;
+			break;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			err = batch_walk(b, path);
+			free(path);
+		} else if (S_ISREG(st.st_mode) && batch_takes(b, d->d_name)) {
+			err = batch_add(b, path, &st);
+		} else {
+			free(path);
+		}
+	}
+	closedir(dir);
+
+	return err;
+}
+
+static int batch_file_cmp(const void *a, const void *b)
+{
+	const struct batch_file *fa = a, *fb = b;
+
+	if (fa->size != fb->size)
+		return fa->size > fb->size ? -1 : 1;
+	if (fa->dev != fb->dev)
+		return fa->dev < fb->dev ? -1 : 1;
+	if (fa->ino != fb->ino)
+		return fa->ino < fb->ino ? -1 : 1;
+	return strcmp(fa->path, fb->path);
+}
+
+/* Remove the duplicates from the sorted file list */
+static void batch_unique(struct batch *b)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < b->nr_files; i++) {
+		if (n && b->files[i].dev == b->files[n - 1].dev &&
+		    b->files[i].ino == b->files[n - 1].ino) {
+			free(b->files[i].path);
+			continue;
+		}
+		b->files[n++] = b->files[i];
+	}
+	b->nr_files = n;
+}
+
+/* Take the next file for a worker */
+static struct batch_file * batch_next(struct batch *b, unsigned int self)
+{
+	struct batch_queue *q;
+	size_t k = 0;
+	unsigned int i, qi;
+	bool found = false;
+
+	for (i = 0; i < b->nr_queues && !found; i++) {
+		qi = (self + i) % b->nr_queues;
+		q = &b->queues[qi];
+		pthread_mutex_lock(&q->lock);
+		if (q->head < q->tail) {
+			k = (i == 0) ? q->head++ : --q->tail;
+			found = true;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	if (!found)
+		return NULL;
+
+	return &b->files[qi + k * b->nr_queues];
+}
+
+static int batch_flush(struct batch_worker *w)
+{
+	const char *buf = w->out;
+	ssize_t res;
+
+	while (w->out_len) {
+		res = write(w->out_fd, buf, w->out_len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += res;
+		w->out_len -= (size_t)res;
+	}
+
+	return 0;
+}
+
+/* Read a block. Returns the number of bytes read, 0 at end of file
+ * or -1 on error. */
+static ssize_t batch_read(int fd, char *buf)
+{
+	size_t len = 0;
+	ssize_t res;
+
+	while (len < BATCH_BLOCK_SIZE) {
+		res = read(fd, buf + len, BATCH_BLOCK_SIZE - len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (res == 0)
+			break;
+		len += (size_t)res;
+	}
+
+	return (ssize_t)len;
+}
+
+/* Run the file through libmorse. Errors are reported.
+ * Text input ends at the first NUL character, like the standard input.
+ * An empty file gives an empty output. */
+static int batch_convert(struct batch_worker *w, const char *path, int in_fd)
+{
+	struct batch *b = w->b;
+	struct morse_ctx ctx;
+	const char *nul;
+	size_t len, pos, consumed, produced;
+	ssize_t res;
+	bool stop_at_nul, eof = false, empty = true;
+
+	stop_at_nul = !(b->flags & MORSE_DECODE) ||
+		      (b->format != MORSE_FMT_BINARY &&
+		       b->format != MORSE_FMT_PACKED);
+	morse_init(&ctx, b->format, b->flags);
+	w->out_len = 0;
+
+	while (!eof) {
+		res = batch_read(in_fd, w->in);
+		if (res < 0) {
+			fprintf(stderr, "%s: Failed to read: %s\n",
+				path, strerror(errno));
+			return -1;
+		}
+		len = (size_t)res;
+		eof = (len < BATCH_BLOCK_SIZE);
+		if (stop_at_nul) {
+			nul = memchr(w->in, '\0', len);
+			if (nul) {
+				len = (size_t)(nul - w->in);
+				eof = true;
+			}
+		}
+		if (len)
+			empty = false;
+		for (pos = 0; pos < len; pos += consumed) {
+			if (morse_process(&ctx, w->in + pos, len - pos, &consumed,
+					  w->out + w->out_len,
+					  BATCH_BLOCK_SIZE - w->out_len,
+					  &produced)) {
+				fprintf(stderr, "%s: %s\n", path, ctx.error);
+				return -1;
+			}
+			w->out_len += produced;
+			if (pos + consumed < len && batch_flush(w))
+				goto write_error;
+		}
+	}
+	if (empty)
+		return 0;
+	if (BATCH_BLOCK_SIZE - w->out_len < MORSE_OUT_SLACK && batch_flush(w))
+		goto write_error;
+	if (morse_finish(&ctx, w->out + w->out_len,
+			 BATCH_BLOCK_SIZE - w->out_len, &produced)) {
+		fprintf(stderr, "%s: %s\n", path, ctx.error);
+		return -1;
+	}
+	w->out_len += produced;
+	if (batch_flush(w))
+		goto write_error;
+
+	return 0;
+
+write_error:
+	fprintf(stderr, "%s: Failed to write: %s\n", path, strerror(errno));
+	return -1;
+}
+
+/* Convert one file. A failed output file is removed. */
+static int batch_process(struct batch_worker *w, const struct batch_file *f)
+{
+	const char *suffix;
+	char *out_path;
+	int in_fd, err = -1;
+
+	suffix = (w->b->flags & MORSE_DECODE) ? BATCH_DECODED_SUFFIX
+					       : BATCH_SUFFIX;
+	out_path = malloc(strlen(f->path) + strlen(suffix) + 1);
+	if (!out_path) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	sprintf(out_path, "%s%s", f->path, suffix);
+
+	in_fd = open(f->path, O_RDONLY | O_CLOEXEC);
+	if (in_fd < 0) {
+		fprintf(stderr, "%s: %s\n", f->path, strerror(errno));
+		goto out;
+	}
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	w->out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (w->out_fd < 0) {
+		fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+		goto out_close;
+	}
+	err = batch_convert(w, f->path, in_fd);
+	if (close(w->out_fd) && !err) {
+		fprintf(stderr, "%s: %s\n", out_path, strerror(errno));
+		err = -1;
+	}
+	if (err)
+		unlink(out_path);
+out_close:
+	close(in_fd);
+out:
+	free(out_path);
+
+	return err;
+}
+
+static void * batch_thread(void *arg)
+{
+	struct batch_worker *w = arg;
+	struct batch_file *f;
+
+	while ((f = batch_next(w->b, w->index))) {
+		if (batch_process(w, f))
+			w->failed = true;
+	}
+
+	return NULL;
+}
+
+/* Encode or decode all files with nr_threads threads.
+ * All files are processed, even if some fail. */
+int batch_run(char * const *paths, unsigned int nr_paths,
+	      enum morse_format format, unsigned int flags,
+	      unsigned int nr_threads)
+{
+	struct batch b = { .format = format, .flags = flags, };
+	struct batch_worker *workers = NULL;
+	struct stat st;
+	char *path;
+	size_t i;
+	unsigned int t, nr_started = 0;
+	int err = 0;
+
+	for (i = 0; i < nr_paths && !err; i++) {
+		if (stat(paths[i], &st)) {
+			fprintf(stderr, "%s: %s\n", paths[i], strerror(errno));
+			err = -1;
+		} else if (S_ISDIR(st.st_mode)) {
+			err = batch_walk(&b, paths[i]);
+		} else if (S_ISREG(st.st_mode)) {
+			path = strdup(paths[i]);
+			err = path ? batch_add(&b, path, &st) : -1;
+		} else {
+			fprintf(stderr, "%s: Not a file or directory\n", paths[i]);
+			err = -1;
+		}
+	}
+	if (err)
+		goto out;
+	qsort(b.files, b.nr_files, sizeof(*b.files), batch_file_cmp);
+	batch_unique(&b);
+
+	nr_threads = (unsigned int)max(min((size_t)nr_threads, b.nr_files), (size_t)1);
+	b.nr_queues = nr_threads;
+	b.queues = calloc(nr_threads, sizeof(*b.queues));
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!b.queues || !workers) {
+		fprintf(stderr, "Out of memory\n");
+		err = -1;
+		goto out;
+	}
+	for (t = 0; t < nr_threads; t++) {
+		pthread_mutex_init(&b.queues[t].lock, NULL);
+		b.queues[t].tail = (b.nr_files + nr_threads - 1 - t) / nr_threads;
+	}
+
+	for (t = 0; t < nr_threads; t++) {
+		workers[t].b = &b;
+		workers[t].index = t;
+		if (posix_memalign((void **)&workers[t].in, BATCH_BLOCK_ALIGN,
+				   BATCH_BLOCK_SIZE) ||
+		    posix_memalign((void **)&workers[t].out, BATCH_BLOCK_ALIGN,
+				   BATCH_BLOCK_SIZE)) {
+			fprintf(stderr, "Out of memory\n");
+			err = -1;
+			break;
+		}
+		/* The calling thread is the first worker. */
+		if (t == 0)
+			continue;
+		if (pthread_create(&workers[t].thread, NULL, batch_thread, &workers[t])) {
+			fprintf(stderr, "Failed to create worker thread\n");
+			err = -1;
+			break;
+		}
+		nr_started++;
+	}
+	if (!err)
+		batch_thread(&workers[0]);
+	for (t = 1; t <= nr_started; t++)
+		pthread_join(workers[t].thread, NULL);
+	for (t = 0; t < nr_threads; t++) {
+		if (workers[t].failed)
+			err = -1;
+		free(workers[t].in);
+		free(workers[t].out);
+	}
+	for (t = 0; t < nr_threads; t++)
+		pthread_mutex_destroy(&b.queues[t].lock);
+out:
+	for (i = 0; i < b.nr_files; i++)
+		free(b.files[i].path);
+	free(b.files);
+	free(b.queues);
+	free(workers);
+
+	return err;
+}
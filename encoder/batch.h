@@ -0,0 +1,21 @@
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "libmorse.h"
+
+
+/* Batch mode.
+ * FILE is encoded to FILE.morse. FILE.morse is decoded to FILE.morse.txt.
+ * Decoding does not restore FILE, because it does not restore the case.
+ * Directories are walked recursively. There, encoding skips the
+ * *.morse and *.morse.txt files and decoding only takes the *.morse files.
+ * So converting a directory again does not pile up files.
+ */
+#define BATCH_SUFFIX		".morse"
+#define BATCH_DECODED_SUFFIX	".txt"
+
+int batch_run(char * const *paths, unsigned int nr_paths,
+	      enum morse_format format, unsigned int flags,
+	      unsigned int nr_threads);
+
+#endif /* BATCH_H_ */
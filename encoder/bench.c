@@ -0,0 +1,717 @@
+/*
+ *  Morse encoder benchmark
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "util.h"
+#include "libmorse.h"
+#include "morse_alphabet.h"
+#include "morse_timing.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+
+/* Encode and decode throughput of morse_encoder.
+ *
+ * Reproducible corpora are generated from a fixed seed. Every corpus is
+ * encoded and decoded in every format by a morse_encoder child process,
+ * reading from a file and writing to /dev/null. The results are printed
+ * as tab separated values, one line per run:
+ *
+ *   corpus mode op jobs bytes chars seconds mb_per_s ns_per_char
+ *   max_rss_kb allocs
+ *
+ * bytes is the size of the input and chars the number of text characters
+ * it holds. MB are 10^6 bytes. seconds is the best of all repetitions.
+ * allocs is only known, if the encoder is the benchmark build that is
+ * linked with bench_alloc.c. It is -1 otherwise.
+ *
+ * With --kernel, libmorse runs in this process on the corpus in memory.
+ * There is no process start and no I/O. The trace modes are left out,
+ * because libmorse does not decode traces. max_rss_kb and allocs are -1.
+ */
+
+/* The trace speed */
+#define BENCH_WPM		20
+/* Input block size of the kernel runs. Like morse_encoder reads. */
+#define BENCH_KERNEL_BLOCK	(64 * 1024)
+
+struct buffer {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+enum bench_input {
+	INPUT_LIB,		/* Encoded by libmorse */
+	INPUT_TRACE,		/* Text key timing trace */
+	INPUT_TRACE_VARINT,	/* Binary key timing trace */
+};
+
+struct bench_mode {
+	const char *name;
+	/* The morse_encoder option */
+	const char *option;
+	enum morse_format format;
+	enum bench_input input;
+	bool decode_only;
+};
+
+static const struct bench_mode modes[] = {
+	{ "dashdot",		"-d", MORSE_FMT_DASHDOT, INPUT_LIB,		false, },
+	{ "ditdah",		"-D", MORSE_FMT_DITDAH,	 INPUT_LIB,		false, },
+	{ "binary",		"-B", MORSE_FMT_BINARY,	 INPUT_LIB,		false, },
+	{ "packed",		"-P", MORSE_FMT_PACKED,	 INPUT_LIB,		false, },
+	{ "trace",		"-t", MORSE_FMT_DASHDOT, INPUT_TRACE,		true, },
+	{ "trace-varint",	"-v", MORSE_FMT_DASHDOT, INPUT_TRACE_VARINT,	true, },
+};
+
+struct corpus {
+	const char *name;
+	void (*generate)(char *buf, size_t len, uint64_t *rng);
+};
+
+struct result {
+	double seconds;
+	long max_rss_kb;
+	long allocs;
+};
+
+static size_t bench_size = 16 << 20;
+static unsigned int bench_runs = 3;
+static unsigned int bench_jobs = 1;
+static const char *bench_corpus;
+static bool bench_kernel;
+static const char *encoder;
+static char tmpdir[] = "/tmp/morse_bench.XXXXXX";
+
+
+static void * checked_realloc(void *buf, size_t size)
+{
+	buf = realloc(buf, size);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	return buf;
+}
+
+static void buffer_reserve(struct buffer *b, size_t len)
+{
+	if (b->len + len <= b->size)
+		return;
+	b->size = max(b->size * 2, b->len + len);
+	b->buf = checked_realloc(b->buf, b->size);
+}
+
+static inline void buffer_putc(struct buffer *b, char c)
+{
+	buffer_reserve(b, 1);
+	b->buf[b->len++] = c;
+}
+
+/* xorshift64* */
+static inline uint32_t rng_next(uint64_t *rng)
+{
+	*rng ^= *rng >> 12;
+	*rng ^= *rng << 25;
+	*rng ^= *rng >> 27;
+
+	return (uint32_t)((*rng * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+/* Uniformly random characters of the whole alphabet */
+static void generate_random(char *buf, size_t len, uint64_t *rng)
+{
+	static const char alphabet[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,:;?-_()'=+/@";
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = alphabet[rng_next(rng) % (sizeof(alphabet) - 1)];
+}
+
+/* English like text. Common words with a roughly Zipf distributed
+ * frequency, commas and sentences. */
+static void generate_english(char *buf, size_t len, uint64_t *rng)
+{
+	static const char *const words[] = {
+		"the", "of", "and", "to", "a", "in", "is", "you", "that", "it",
+		"he", "was", "for", "on", "are", "as", "with", "his", "they", "i",
+		"at", "be", "this", "have", "from", "or", "one", "had", "by", "word",
+		"but", "not", "what", "all", "were", "we", "when", "your", "can", "said",
+		"there", "use", "an", "each", "which", "she", "do", "how", "their", "if",
+		"will", "up", "other", "about", "out", "many", "then", "them", "these", "so",
+		"some", "her", "would", "make", "like", "him", "into", "time", "has", "look",
+		"two", "more", "write", "go", "see", "number", "no", "way", "could", "people",
+		"station", "signal", "antenna", "frequency", "weather", "report", "73", "1200",
+	};
+	const unsigned int nr_words = ARRAY_SIZE(words);
+	unsigned int index, sentence = 0;
+	const char *word;
+	size_t pos = 0;
+	char c;
+
+	while (pos < len) {
+		index = (rng_next(rng) % nr_words) * (rng_next(rng) % nr_words) / nr_words;
+		for (word = words[index]; *word && pos < len; word++) {
+			c = *word;
+			if (!sentence && word == words[index] && c >= 'a' && c <= 'z')
+				c = (char)(c - 'a' + 'A');
+			buf[pos++] = c;
+		}
+		sentence++;
+		if (pos < len && sentence > 6 && rng_next(rng) % 8 == 0) {
+			buf[pos++] = '.';
+			sentence = 0;
+		} else if (pos < len && rng_next(rng) % 16 == 0) {
+			buf[pos++] = ',';
+		}
+		if (pos < len)
+			buf[pos++] = ' ';
+	}
+}
+
+/* Only the characters with the most marks */
+static void generate_worst(char *buf, size_t len, uint64_t *rng)
+{
+	char longest[256];
+	unsigned int i, nr = 0, size, max_size = 0;
+	morse_sym_t sym;
+	size_t pos;
+
+	for (i = 1; i < 256; i++) {
+		sym = morse_ascii_to_sym((char)i);
+		if (sym == MORSE_SYM_INVALID)
+			continue;
+		size = MORSE_SYM_SIZE(sym);
+		if (size > max_size) {
+			max_size = size;
+			nr = 0;
+		}
+		if (size == max_size)
+			longest[nr++] = (char)i;
+	}
+	for (pos = 0; pos < len; pos++)
+		buf[pos] = longest[rng_next(rng) % nr];
+}
+
+static const struct corpus corpora[] = {
+	{ "random",	generate_random, },
+	{ "english",	generate_english, },
+	{ "worst",	generate_worst, },
+};
+
+/* Append a trace duration */
+static void trace_put(struct buffer *b, enum bench_input input,
+		      bool mark, unsigned int ms)
+{
+	uint32_t v;
+
+	if (input == INPUT_TRACE) {
+		buffer_reserve(b, 16);
+		b->len += (size_t)sprintf(&b->buf[b->len], "%c%u ",
+					  mark ? '+' : '-', ms);
+		return;
+	}
+	v = (uint32_t)ms << 1 | mark;
+	do {
+		buffer_putc(b, (char)((v & 0x7F) | (v > 0x7F ? 0x80 : 0)));
+		v >>= 7;
+	} while (v);
+}
+
+/* Append the key timing trace of a text */
+static void trace_text(struct buffer *b, enum bench_input input,
+		       const char *text, size_t len)
+{
+	const unsigned int dit = DIT_LENGTH_1WPM_MS / BENCH_WPM;
+	morse_sym_t sym;
+	unsigned int i;
+	size_t pos;
+
+	for (pos = 0; pos < len; pos++) {
+		sym = morse_ascii_to_sym(text[pos]);
+		if (MORSE_SYM_IS_SPACE(sym)) {
+			trace_put(b, input, false,
+				  dit * (FACTOR_INTER_WORD - FACTOR_INTER_CHAR));
+			continue;
+		}
+		for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
+			if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT)
+				trace_put(b, input, true, dit * FACTOR_DIT);
+			else
+				trace_put(b, input, true, dit * FACTOR_DAH);
+			trace_put(b, input, false, dit * (i == MORSE_SYM_SIZE(sym) - 1u ?
+							  FACTOR_INTER_CHAR : FACTOR_INTER_MARK));
+		}
+	}
+}
+
+/* Append the libmorse encoding of a text */
+static int encode_text(struct buffer *b, enum morse_format format,
+		       const char *text, size_t len, bool finish)
+{
+	struct morse_ctx ctx;
+	size_t consumed, produced;
+
+	morse_init(&ctx, format, 0);
+	while (len) {
+		buffer_reserve(b, morse_out_bound(&ctx, len));
+		if (morse_process(&ctx, text, len, &consumed,
+				  &b->buf[b->len], b->size - b->len, &produced))
+			goto error;
+		b->len += produced;
+		text += consumed;
+		len -= consumed;
+	}
+	if (finish) {
+		buffer_reserve(b, MORSE_OUT_SLACK);
+		if (morse_finish(&ctx, &b->buf[b->len], b->size - b->len, &produced))
+			goto error;
+		b->len += produced;
+	}
+
+	return 0;
+
+error:
+	fprintf(stderr, "Failed to encode the corpus: %s\n", ctx.error);
+	return -1;
+}
+
+/* Build the decoder input of about bench_size bytes.
+ * The text is repeated, if it encodes to less than that. */
+static int decoder_input(struct buffer *b, const struct bench_mode *m,
+			 const char *text, size_t *nr_chars)
+{
+	const size_t piece = 4096;
+	size_t pos = 0, len;
+
+	*nr_chars = 0;
+	while (b->len < bench_size) {
+		len = min(piece, bench_size - pos);
+		if (m->input == INPUT_LIB) {
+			/* Only the packed stream needs a terminator. */
+			if (encode_text(b, m->format, &text[pos], len,
+					m->format == MORSE_FMT_PACKED))
+				return -1;
+		} else {
+			trace_text(b, m->input, &text[pos], len);
+		}
+		*nr_chars += len;
+		pos += len;
+		if (pos >= bench_size)
+			pos = 0;
+	}
+
+	return 0;
+}
+
+static int write_file(const char *path, const char *buf, size_t len)
+{
+	ssize_t res;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		goto error;
+	while (len) {
+		res = write(fd, buf, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			goto error;
+		}
+		buf += res;
+		len -= (size_t)res;
+	}
+	if (close(fd))
+		goto error;
+
+	return 0;
+
+error:
+	fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Run the encoder once */
+static int run_once(const char *input, const struct bench_mode *m,
+		    bool decode, struct result *r)
+{
+	char jobs[16], fd_name[16], count[32];
+	char *argv[8];
+	unsigned int argc = 0;
+	struct rusage usage;
+	double start;
+	ssize_t res;
+	pid_t pid;
+	int status, fd, fds[2];
+
+	if (pipe(fds)) {
+		fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
+		return -1;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	snprintf(fd_name, sizeof(fd_name), "%d", fds[1]);
+	setenv("MORSE_BENCH_ALLOC_FD", fd_name, 1);
+
+	snprintf(jobs, sizeof(jobs), "%u", bench_jobs);
+	argv[argc++] = (char *)encoder;
+	argv[argc++] = (char *)m->option;
+	if (decode)
+		argv[argc++] = "-x";
+	argv[argc++] = "-j";
+	argv[argc++] = jobs;
+	argv[argc] = NULL;
+
+	/* fork() instead of posix_spawn(). A child sharing our memory
+	 * until exec would inherit our peak RSS. */
+	start = now();
+	pid = fork();
+	if (pid == 0) {
+		fd = open(input, O_RDONLY);
+		if (fd < 0 || dup2(fd, STDIN_FILENO) < 0)
+			_exit(127);
+		fd = open("/dev/null", O_WRONLY);
+		if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0)
+			_exit(127);
+		execv(encoder, argv);
+		fprintf(stderr, "Failed to run %s: %s\n", encoder, strerror(errno));
+		_exit(127);
+	}
+	close(fds[1]);
+	if (pid < 0) {
+		fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+		close(fds[0]);
+		return -1;
+	}
+	while (wait4(pid, &status, 0, &usage) < 0) {
+		if (errno != EINTR) {
+			fprintf(stderr, "Failed to wait for the encoder: %s\n",
+				strerror(errno));
+			close(fds[0]);
+			return -1;
+		}
+	}
+	r->seconds = now() - start;
+	r->max_rss_kb = usage.ru_maxrss;
+
+	res = read(fds[0], count, sizeof(count) - 1);
+	close(fds[0]);
+	if (res > 0) {
+		count[res] = '\0';
+		r->allocs = atol(count);
+	} else {
+		r->allocs = -1;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "%s %s%s failed\n", encoder, m->option,
+			decode ? " -x" : "");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Run libmorse once on the input in memory.
+ * The output is produced into one block sized buffer and dropped. */
+static int run_kernel(const struct buffer *input, const struct bench_mode *m,
+		      bool decode, struct result *r)
+{
+	struct morse_ctx ctx;
+	size_t pos, len, consumed, produced, out_size;
+	char *out;
+	double start;
+	int err;
+
+	morse_init(&ctx, m->format, decode ? MORSE_DECODE : 0);
+	out_size = morse_out_bound(&ctx, BENCH_KERNEL_BLOCK) + MORSE_OUT_SLACK;
+	out = checked_realloc(NULL, out_size);
+
+	start = now();
+	for (pos = 0; pos < input->len; pos += len) {
+		len = min(input->len - pos, (size_t)BENCH_KERNEL_BLOCK);
+		err = morse_process(&ctx, &input->buf[pos], len, &consumed,
+				    out, out_size, &produced);
+		if (err || consumed != len)
+			goto error;
+	}
+	if (morse_finish(&ctx, out, out_size, &produced))
+		goto error;
+	r->seconds = now() - start;
+	r->max_rss_kb = -1;
+	r->allocs = -1;
+	free(out);
+
+	return 0;
+
+error:
+	fprintf(stderr, "libmorse %s%s failed: %s\n", m->option,
+		decode ? " -x" : "", ctx.error);
+	free(out);
+	return -1;
+}
+
+/* Run the encoder bench_runs times and print the best result.
+ * input is a file. With --kernel, it is the struct buffer itself. */
+static int bench(const struct corpus *c, const struct bench_mode *m,
+		 bool decode, const void *input, size_t bytes, size_t chars)
+{
+	struct result best = { .max_rss_kb = -1, }, r;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < bench_runs; i++) {
+		if (bench_kernel)
+			err = run_kernel(input, m, decode, &r);
+		else
+			err = run_once(input, m, decode, &r);
+		if (err)
+			return -1;
+		if (!i || r.seconds < best.seconds)
+			best.seconds = r.seconds;
+		best.max_rss_kb = max(best.max_rss_kb, r.max_rss_kb);
+		best.allocs = r.allocs;
+	}
+	printf("%s\t%s\t%s\t%u\t%zu\t%zu\t%.6f\t%.2f\t%.3f\t%ld\t%ld\n",
+	       c->name, m->name, decode ? "decode" : "encode",
+	       bench_kernel ? 1 : bench_jobs,
+	       bytes, chars, best.seconds, (double)bytes / best.seconds / 1e6,
+	       best.seconds * 1e9 / (double)chars, best.max_rss_kb, best.allocs);
+	fflush(stdout);
+
+	return 0;
+}
+
+/* Build the input of one run.
+ * The corpus is generated again every time. */
+static int bench_input(const struct corpus *c, const struct bench_mode *m,
+		       bool decode, struct buffer *b, size_t *chars)
+{
+	uint64_t rng = 0x9E3779B97F4A7C15ull;
+	char *text;
+	int err = 0;
+
+	text = checked_realloc(NULL, bench_size);
+	c->generate(text, bench_size, &rng);
+	if (decode) {
+		err = decoder_input(b, m, text, chars);
+		free(text);
+	} else {
+		b->buf = text;
+		b->len = b->size = bench_size;
+		*chars = bench_size;
+	}
+
+	return err;
+}
+
+/* Write the input file of one run and run the encoder on it.
+ * All memory is released before the encoder runs, because the RSS
+ * of the parent at fork() counts towards the peak RSS of the child. */
+static int bench_mode_run(const struct corpus *c, const struct bench_mode *m,
+			  bool decode, const char *path)
+{
+	struct buffer b = { NULL, };
+	size_t bytes, chars;
+	int err;
+
+	err = bench_input(c, m, decode, &b, &chars);
+	bytes = b.len;
+	if (!err && bench_kernel) {
+		err = bench(c, m, decode, &b, bytes, chars);
+		free(b.buf);
+		return err;
+	}
+	if (!err)
+		err = write_file(path, b.buf, b.len);
+	free(b.buf);
+	if (!err)
+		err = bench(c, m, decode, path, bytes, chars);
+	unlink(path);
+
+	return err;
+}
+
+static int bench_corpus_run(const struct corpus *c)
+{
+	char path[sizeof(tmpdir) + 16];
+	unsigned int i, decode;
+	int err = 0;
+
+	snprintf(path, sizeof(path), "%s/input", tmpdir);
+	for (decode = 0; decode <= 1 && !err; decode++) {
+		for (i = 0; i < ARRAY_SIZE(modes) && !err; i++) {
+			if (modes[i].decode_only && !decode)
+				continue;
+			if (bench_kernel && modes[i].input != INPUT_LIB)
+				continue;
+			err = bench_mode_run(c, &modes[i], decode, path);
+		}
+	}
+
+	return err;
+}
+
+static void usage(int argc, char **argv)
+{
+	printf("Usage: %s <options> ENCODER\n", argv[0]);
+	printf("       %s <options> --kernel\n\n", argv[0]);
+	printf("Options:\n");
+	printf(" -s|--size MIB        Corpus size in MiB (default 16)\n");
+	printf(" -r|--runs N          Repetitions per measurement (default 3)\n");
+	printf(" -j|--jobs N          Run the encoder with N threads (default 1)\n");
+	printf(" -c|--corpus NAME     Only this corpus: random, english or worst\n");
+	printf(" -k|--kernel          Time libmorse in process, without I/O\n");
+}
+
+static int parse_uint(const char *str, unsigned int min, unsigned int max,
+		      const char *name, unsigned int *value)
+{
+	unsigned long v;
+	char *end;
+
+	v = strtoul(str, &end, 10);
+	if (!*str || *end || v < min || v > max) {
+		fprintf(stderr, "Invalid %s: %s\n", name, str);
+		return -1;
+	}
+	*value = (unsigned int)v;
+
+	return 0;
+}
+
+static int parse_args(int argc, char **argv)
+{
+	unsigned int size;
+	int i = 0, c;
+
+	static const struct option long_opts[] = {
+		{ .name = "help",	.has_arg = no_argument, .flag = NULL, .val = 'h' },
+		{ .name = "size",	.has_arg = required_argument, .flag = NULL, .val = 's' },
+		{ .name = "runs",	.has_arg = required_argument, .flag = NULL, .val = 'r' },
+		{ .name = "jobs",	.has_arg = required_argument, .flag = NULL, .val = 'j' },
+		{ .name = "corpus",	.has_arg = required_argument, .flag = NULL, .val = 'c' },
+		{ .name = "kernel",	.has_arg = no_argument, .flag = NULL, .val = 'k' },
+		{ .name = NULL, },
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "hs:r:j:c:k", long_opts, &i);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'h':
+			usage(argc, argv);
+			return 1;
+		case 's':
+			if (parse_uint(optarg, 1, 16384, "size", &size))
+				return -1;
+			bench_size = (size_t)size << 20;
+			break;
+		case 'r':
+			if (parse_uint(optarg, 1, 1000, "number of runs", &bench_runs))
+				return -1;
+			break;
+		case 'j':
+			if (parse_uint(optarg, 1, 1024, "number of jobs", &bench_jobs))
+				return -1;
+			break;
+		case 'c':
+			bench_corpus = optarg;
+			break;
+		case 'k':
+			bench_kernel = true;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (optind != argc - (bench_kernel ? 0 : 1)) {
+		usage(argc, argv);
+		return -1;
+	}
+	encoder = argv[optind];
+	if (bench_corpus) {
+		for (i = 0; i < (int)ARRAY_SIZE(corpora); i++) {
+			if (!strcmp(bench_corpus, corpora[i].name))
+				break;
+		}
+		if (i == (int)ARRAY_SIZE(corpora)) {
+			fprintf(stderr, "Unknown corpus: %s\n", bench_corpus);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i;
+	int err;
+
+	err = parse_args(argc, argv);
+	if (err > 0)
+		return 0;
+	if (err < 0)
+		return 1;
+
+	/* A fixed threshold keeps the corpus buffers in mmap()ed memory,
+	 * which is released by free(). See bench_input(). */
+	mallopt(M_MMAP_THRESHOLD, 256 * 1024);
+
+	if (!mkdtemp(tmpdir)) {
+		fprintf(stderr, "Failed to create %s: %s\n", tmpdir, strerror(errno));
+		return 1;
+	}
+	printf("corpus\tmode\top\tjobs\tbytes\tchars\tseconds\tmb_per_s\t"
+	       "ns_per_char\tmax_rss_kb\tallocs\n");
+	for (i = 0; i < ARRAY_SIZE(corpora) && !err; i++) {
+		if (bench_corpus && strcmp(bench_corpus, corpora[i].name))
+			continue;
+		err = bench_corpus_run(&corpora[i]);
+	}
+	rmdir(tmpdir);
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ *  Allocation counter for the benchmark build of morse_encoder
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/* The benchmark binary is linked with
+ *   -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * so every allocation of our own code is counted here. Allocations
+ * inside the C library are not. The count is written to the file
+ * descriptor named by MORSE_BENCH_ALLOC_FD at exit.
+ */
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t nmemb, size_t size);
+void * __real_realloc(void *ptr, size_t size);
+
+static unsigned long nr_allocs;
+
+void * __wrap_malloc(size_t size)
+{
+	__atomic_add_fetch(&nr_allocs, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&nr_allocs, 1, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void * __wrap_realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&nr_allocs, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+__attribute__((destructor))
+static void bench_alloc_report(void)
+{
+	const char *env = getenv("MORSE_BENCH_ALLOC_FD");
+	char buf[32];
+	int len;
+
+	if (!env)
+		return;
+	len = snprintf(buf, sizeof(buf), "%lu\n",
+		       __atomic_load_n(&nr_allocs, __ATOMIC_RELAXED));
+	if (write(atoi(env), buf, (size_t)len) != len)
+		fprintf(stderr, "Failed to report the allocation count\n");
+}
@@ -0,0 +1,277 @@
+/*
+ *  Morse encoder client
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "util.h"
+#include "server.h"
+#include "libmorse.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/* A drop-in for a morse_encoder invocation with the text formats.
+ * The request goes to a running "morse_encoder --listen PATH". */
+
+static const char *socket_path;
+static enum morse_format format = MORSE_FMT_DASHDOT;
+static unsigned int flags;
+/* The header and the payload of the request */
+static char request[SERVER_HDR_SIZE + SERVER_MAX_LEN];
+static size_t input_len;
+static bool have_args;
+
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+	ssize_t res;
+
+	while (len) {
+		res = write(fd, buf, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += res;
+		len -= (size_t)res;
+	}
+
+	return 0;
+}
+
+/* Returns the number of bytes read. Less than size at end of file. */
+static ssize_t read_full(int fd, char *buf, size_t size)
+{
+	size_t len = 0;
+	ssize_t res;
+
+	while (len < size) {
+		res = read(fd, buf + len, size - len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (res == 0)
+			break;
+		len += (size_t)res;
+	}
+
+	return (ssize_t)len;
+}
+
+static int read_input(void)
+{
+	char *input = &request[SERVER_HDR_SIZE];
+	const char *nul;
+	ssize_t res;
+	char c;
+
+	res = read_full(STDIN_FILENO, input, SERVER_MAX_LEN);
+	if (res < 0) {
+		fprintf(stderr, "Failed to read input: %s\n", strerror(errno));
+		return -1;
+	}
+	input_len = (size_t)res;
+	/* Text input ends at the first NUL character */
+	if (!(flags & MORSE_DECODE) ||
+	    (format != MORSE_FMT_BINARY && format != MORSE_FMT_PACKED)) {
+		nul = memchr(input, '\0', input_len);
+		if (nul) {
+			input_len = (size_t)(nul - input);
+			return 0;
+		}
+	}
+	if (input_len == SERVER_MAX_LEN && read_full(STDIN_FILENO, &c, 1) == 1) {
+		fprintf(stderr, "Input too long (max %u bytes)\n", SERVER_MAX_LEN);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int run_request(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX, };
+	char hdr[SERVER_HDR_SIZE], buf[64 * 1024];
+	size_t len, count;
+	ssize_t res;
+	int fd, err = -1;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", socket_path);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		fprintf(stderr, "Failed to connect to %s: %s\n",
+			socket_path, strerror(errno));
+		goto out;
+	}
+
+	server_header(request, (uint32_t)input_len, (uint8_t)format, (uint8_t)flags);
+	if (write_full(fd, request, SERVER_HDR_SIZE + input_len))
+		goto io_error;
+	if (read_full(fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr))
+		goto io_error;
+
+	/* Copy the reply payload to stdout or stderr */
+	len = get_le32(hdr);
+	while (len) {
+		count = min(len, sizeof(buf));
+		res = read_full(fd, buf, count);
+		if (res != (ssize_t)count)
+			goto io_error;
+		if (hdr[4] == SERVER_OK) {
+			if (write_full(STDOUT_FILENO, buf, count)) {
+				fprintf(stderr, "Failed to write output: %s\n",
+					strerror(errno));
+				goto out;
+			}
+		} else {
+			fwrite(buf, 1, count, stderr);
+		}
+		len -= count;
+	}
+	if (hdr[4] == SERVER_OK)
+		err = 0;
+	else
+		fputc('\n', stderr);
+	goto out;
+
+io_error:
+	fprintf(stderr, "Server connection failed\n");
+out:
+	if (fd >= 0)
+		close(fd);
+	return err;
+}
+
+static void usage(int argc, char **argv)
+{
+	printf("Usage: %s <options> [STRING]\n\n", argv[0]);
+	printf("Options:\n");
+	printf(" -s|--socket PATH     Server socket (default $MORSE_SOCKET)\n");
+	printf(" -b|--bigendian       Bigendian symbols (default little endian)\n");
+	printf(" -B|--binary          Binary format\n");
+	printf(" -d|--dashdot         Human readable dash/dot format (default)\n");
+	printf(" -D|--ditdah          Human readable dit/dah format\n");
+	printf(" -P|--packed          Packed variable length bitstream format\n");
+	printf(" -x|--decode          Switch to decode mode\n");
+}
+
+static int parse_args(int argc, char **argv)
+{
+	char *input = &request[SERVER_HDR_SIZE];
+	int i = 0, c;
+	size_t len;
+
+	static const struct option long_opts[] = {
+		{ .name = "help",	.has_arg = no_argument, .flag = NULL, .val = 'h' },
+		{ .name = "socket",	.has_arg = required_argument, .flag = NULL, .val = 's' },
+		{ .name = "bigendian",	.has_arg = no_argument, .flag = NULL, .val = 'b' },
+		{ .name = "binary",	.has_arg = no_argument, .flag = NULL, .val = 'B' },
+		{ .name = "ditdah",	.has_arg = no_argument, .flag = NULL, .val = 'D' },
+		{ .name = "dashdot",	.has_arg = no_argument, .flag = NULL, .val = 'd' },
+		{ .name = "packed",	.has_arg = no_argument, .flag = NULL, .val = 'P' },
+		{ .name = "decode",	.has_arg = no_argument, .flag = NULL, .val = 'x' },
+		{ .name = NULL, },
+	};
+
+	socket_path = getenv("MORSE_SOCKET");
+	while (1) {
+		c = getopt_long(argc, argv, "hs:bBdDPx", long_opts, &i);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'h':
+			usage(argc, argv);
+			return 1;
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'b':
+			flags |= MORSE_BIGENDIAN;
+			break;
+		case 'B':
+			format = MORSE_FMT_BINARY;
+			break;
+		case 'd':
+			format = MORSE_FMT_DASHDOT;
+			break;
+		case 'D':
+			format = MORSE_FMT_DITDAH;
+			break;
+		case 'P':
+			format = MORSE_FMT_PACKED;
+			break;
+		case 'x':
+			flags |= MORSE_DECODE;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (!socket_path) {
+		fprintf(stderr, "No server socket. Use --socket or $MORSE_SOCKET\n");
+		return -1;
+	}
+	/* The arguments are joined with spaces. Like morse_encoder does. */
+	for (i = optind; i < argc; i++) {
+		len = strlen(argv[i]);
+		if (input_len + len + 1 > SERVER_MAX_LEN) {
+			fprintf(stderr, "Input too long (max %u bytes)\n",
+				SERVER_MAX_LEN);
+			return -1;
+		}
+		if (have_args)
+			input[input_len++] = ' ';
+		memcpy(&input[input_len], argv[i], len);
+		input_len += len;
+		have_args = true;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	err = parse_args(argc, argv);
+	if (err > 0)
+		return 0;
+	if (err < 0)
+		return 1;
+	if (!have_args && read_input())
+		return 1;
+	/* Empty input fails, like morse_encoder does. */
+	if (!input_len)
+		return 1;
+
+	return run_request() ? 1 : 0;
+}
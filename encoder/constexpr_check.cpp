@@ -0,0 +1,34 @@
+/* Build time check of morse_constexpr.h.
+ * Nothing of this ends up in a program. The expected bytes are the
+ * output of morse_encoder -B and -P for the same string. So a change
+ * to morse_alphabet.h or to the packed format, which is not done
+ * to both, fails the build here.
+ */
+
+#include "morse_constexpr.h"
+
+
+template <typename T>
+constexpr bool equal(const T *a, const T *b, unsigned int n)
+{
+	return !n || (*a == *b && equal(a + 1, b + 1, n - 1));
+}
+
+/* morse_encoder -B "PARIS 73?" */
+static constexpr auto syms = MORSE_SYMS("PARIS 73?");
+static constexpr morse_sym_t syms_expected[] = {
+	0x4006, 0x2002, 0x3002, 0x2000, 0x3000,
+	0x0000, 0x5003, 0x5018, 0x600C,
+};
+static_assert(sizeof(syms.sym) == sizeof(syms_expected) &&
+	      equal(syms.sym, syms_expected, sizeof(syms_expected) / sizeof(syms_expected[0])),
+	      "MORSE_SYMS() differs from morse_encoder -B");
+
+/* morse_encoder -P "PARIS 73?" */
+static constexpr auto packed = MORSE_PACKED("PARIS 73?");
+static constexpr uint8_t packed_expected[] = {
+	0x64, 0xE2, 0x48, 0x18, 0x40, 0x8D, 0xC2, 0xC6, 0x3C,
+};
+static_assert(sizeof(packed.byte) == sizeof(packed_expected) &&
+	      equal(packed.byte, packed_expected, sizeof(packed_expected)),
+	      "MORSE_PACKED() differs from morse_encoder -P");
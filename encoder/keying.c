@@ -0,0 +1,166 @@
+/*
+ *  Morse key timing decoder
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "keying.h"
+#include "morse_timing.h"
+
+#include <string.h>
+
+
+/* This follows the symbol capture of the myavr_morsedec firmware
+ * (TIMER2_COMP_vect): A mark up to the "dit" threshold is a dit,
+ * anything longer is a dah. A gap of the inter character length ends
+ * the symbol and a gap of the inter word length ends the word.
+ * The firmware compares against the nominal lengths. Measured lengths
+ * jitter around those, so the thresholds here are the midpoints
+ * between the nominal lengths.
+ */
+static void key_decoder_thresholds(struct key_decoder *k)
+{
+	k->char_gap_min = morse_speed_threshold(&k->speed, FACTOR_INTER_MARK,
+						FACTOR_INTER_CHAR);
+	k->word_gap_min = morse_speed_threshold_long(&k->speed, FACTOR_INTER_CHAR,
+						     FACTOR_INTER_WORD);
+}
+
+/* Set a fixed "dit" length. */
+void key_decoder_set_dit(struct key_decoder *k, unsigned int dit_len)
+{
+	dit_len = clamp(dit_len, 1u, (unsigned int)MORSE_SPEED_MAX_LEN);
+	morse_speed_init(&k->speed, (uint16_t)dit_len,
+			 (uint16_t)dit_len, (uint16_t)dit_len);
+	key_decoder_thresholds(k);
+}
+
+/* Track the speed of the sender, starting at the current "dit" length.
+ * The "dit" length stays between dit_min and dit_max. */
+void key_decoder_track(struct key_decoder *k, unsigned int dit_min,
+		       unsigned int dit_max)
+{
+	dit_min = clamp(dit_min, 1u, (unsigned int)MORSE_SPEED_MAX_LEN);
+	dit_max = clamp(dit_max, dit_min, (unsigned int)MORSE_SPEED_MAX_LEN);
+	morse_speed_init(&k->speed, morse_speed_dit(&k->speed),
+			 (uint16_t)dit_min, (uint16_t)dit_max);
+}
+
+void key_decoder_init(struct key_decoder *k, unsigned int dit_len,
+		      void (*emit)(void *opaque, morse_sym_t sym),
+		      void *opaque)
+{
+	memset(k, 0, sizeof(*k));
+	key_decoder_set_dit(k, dit_len);
+	/* Key changes shorter than half a "dit" are glitches */
+	k->debounce = max(dit_len / 2, 1u);
+	k->emit = emit;
+	k->opaque = opaque;
+}
+
+void key_decoder_mark(struct key_decoder *k, unsigned int len)
+{
+	bool dah;
+
+	dah = morse_speed_mark(&k->speed, (uint16_t)min(len, (unsigned int)MORSE_SPEED_MAX_LEN));
+	key_decoder_thresholds(k);
+	if (k->nr_marks >= MORSE_MAX_NR_MARKS) {
+		k->overflow = true;
+		return;
+	}
+	if (dah)
+		k->symbol |= (morse_sym_t)(MORSE_DAH << k->nr_marks);
+	k->nr_marks++;
+}
+
+/* End the current symbol, if any. */
+void key_decoder_flush(struct key_decoder *k)
+{
+	if (!k->nr_marks)
+		return;
+	if (k->overflow)
+		k->emit(k->opaque, MORSE_SYM_INVALID);
+	else
+		k->emit(k->opaque, __MORSE_SYM(k->symbol, k->nr_marks));
+	k->symbol = 0;
+	k->nr_marks = 0;
+	k->overflow = false;
+	k->in_word = true;
+}
+
+/* Handle a gap of at least len. May be called repeatedly
+ * for a growing gap. */
+static void key_decoder_gap_run(struct key_decoder *k, unsigned int len)
+{
+	if (len < k->char_gap_min)
+		return;
+	key_decoder_flush(k);
+	if (len >= k->word_gap_min && k->in_word) {
+		k->emit(k->opaque, __MORSE_SYM(0, 0)); /* Space */
+		k->in_word = false;
+	}
+}
+
+static void key_decoder_gap_end(struct key_decoder *k, unsigned int len)
+{
+	if (len <= MORSE_SPEED_MAX_LEN) {
+		morse_speed_gap(&k->speed, (uint16_t)len);
+		key_decoder_thresholds(k);
+	}
+}
+
+void key_decoder_gap(struct key_decoder *k, unsigned int len)
+{
+	key_decoder_gap_run(k, len);
+	key_decoder_gap_end(k, len);
+}
+
+/* Feed one sample of a periodically sampled key.
+ * The dit length is in samples then. Characters and spaces are emitted
+ * as soon as the gap is long enough, not only when the next mark starts.
+ */
+void key_decoder_sample(struct key_decoder *k, bool key)
+{
+	if (key == k->key) {
+		k->run += k->flip + 1;
+		k->flip = 0;
+		if (!key)
+			key_decoder_gap_run(k, k->run);
+		return;
+	}
+	/* Debounce. Delaying both edges keeps the run lengths. */
+	if (++k->flip < k->debounce)
+		return;
+	if (k->key)
+		key_decoder_mark(k, k->run);
+	else
+		key_decoder_gap_end(k, k->run);
+	k->key = key;
+	k->run = k->flip;
+	k->flip = 0;
+}
+
+/* End the sampled input. */
+void key_decoder_finish(struct key_decoder *k)
+{
+	if (k->key && k->run)
+		key_decoder_mark(k, k->run);
+	k->key = false;
+	k->run = 0;
+	k->flip = 0;
+	key_decoder_flush(k);
+}
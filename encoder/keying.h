@@ -0,0 +1,57 @@
+#ifndef KEYING_H_
+#define KEYING_H_
+
+#include "util.h"
+#include "morse_encoder.h"
+#include "morse_alphabet.h"
+#include "morse_speed.h"
+
+
+/* Key timing decoder.
+ * Turns the lengths of marks (key down) and gaps (key up) into
+ * morse symbols. The lengths are in arbitrary time units, as long as
+ * the "dit" length is given in the same unit.
+ */
+struct key_decoder {
+	/* The "dit" length */
+	struct morse_speed speed;
+	/* The shortest gap between characters */
+	unsigned int char_gap_min;
+	/* The shortest gap between words */
+	unsigned int word_gap_min;
+
+	/* The symbol being received */
+	morse_sym_t symbol;
+	unsigned int nr_marks;
+	/* The symbol has too many marks */
+	bool overflow;
+	/* A character was emitted since the last word space */
+	bool in_word;
+
+	/* Sampled key input state. See key_decoder_sample(). */
+	unsigned int debounce;
+	/* The current key state and its length, in samples */
+	bool key;
+	unsigned int run;
+	/* Samples since the input last disagreed with the key state */
+	unsigned int flip;
+
+	/* Called for every received symbol.
+	 * MORSE_SYM_INVALID is passed for garbage. */
+	void (*emit)(void *opaque, morse_sym_t sym);
+	void *opaque;
+};
+
+void key_decoder_init(struct key_decoder *k, unsigned int dit_len,
+		      void (*emit)(void *opaque, morse_sym_t sym),
+		      void *opaque);
+void key_decoder_set_dit(struct key_decoder *k, unsigned int dit_len);
+void key_decoder_track(struct key_decoder *k, unsigned int dit_min,
+		       unsigned int dit_max);
+void key_decoder_mark(struct key_decoder *k, unsigned int len);
+void key_decoder_gap(struct key_decoder *k, unsigned int len);
+void key_decoder_flush(struct key_decoder *k);
+void key_decoder_sample(struct key_decoder *k, bool key);
+void key_decoder_finish(struct key_decoder *k);
+
+#endif /* KEYING_H_ */
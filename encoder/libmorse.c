@@ -0,0 +1,1134 @@
+/*
+ *  libmorse - Reentrant morse encoder and decoder
+ *
+ *  Copyright (C) 2011 Michael Buesch <m@bues.ch>
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "libmorse.h"
+#include "morse_alphabet.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_AVX2
+#endif
+
+
+/* The morse alphabet */
+enum morse_character {
+	/* Characters */
+	MORSE_A		= 'A',
+	MORSE_B		= 'B',
+	MORSE_C		= 'C',
+	MORSE_D		= 'D',
+	MORSE_E		= 'E',
+	MORSE_F		= 'F',
+	MORSE_G		= 'G',
+	MORSE_H		= 'H',
+	MORSE_I		= 'I',
+	MORSE_J		= 'J',
+	MORSE_K		= 'K',
+	MORSE_L		= 'L',
+	MORSE_M		= 'M',
+	MORSE_N		= 'N',
+	MORSE_O		= 'O',
+	MORSE_P		= 'P',
+	MORSE_Q		= 'Q',
+	MORSE_R		= 'R',
+	MORSE_S		= 'S',
+	MORSE_T		= 'T',
+	MORSE_U		= 'U',
+	MORSE_V		= 'V',
+	MORSE_W		= 'W',
+	MORSE_X		= 'X',
+	MORSE_Y		= 'Y',
+	MORSE_Z		= 'Z',
+
+	MORSE_CHARS_START	= MORSE_A,
+	MORSE_CHARS_END		= MORSE_Z,
+
+	/* Numbers */
+	MORSE_0		= '0',
+	MORSE_1		= '1',
+	MORSE_2		= '2',
+	MORSE_3		= '3',
+	MORSE_4		= '4',
+	MORSE_5		= '5',
+	MORSE_6		= '6',
+	MORSE_7		= '7',
+	MORSE_8		= '8',
+	MORSE_9		= '9',
+
+	MORSE_NUMS_START	= MORSE_0,
+	MORSE_NUMS_END		= MORSE_9,
+
+	/* Special characters */
+	MORSE_GACC_A	= 128,		/* grave accent A */
+	MORSE_AE,			/* Ä */
+	MORSE_GACC_E,			/* grave accent E */
+	MORSE_AACC_E,			/* acute accent E */
+	MORSE_OE,			/* Ö */
+	MORSE_UE,			/* Ü */
+	MORSE_SZ,			/* ß */
+	MORSE_CH,			/* CH */
+	MORSE_TILDE_N,			/* tilde N */
+	MORSE_PERIOD,			/* . */
+	MORSE_COMMA,			/* , */
+	MORSE_COLON,			/* : */
+	MORSE_SEMICOLON,		/* ; */
+	MORSE_QUESTION,			/* ? */
+	MORSE_DASH,			/* - */
+	MORSE_UNDERSCORE,		/* _ */
+	MORSE_PAREN_OPEN,		/* ( */
+	MORSE_PAREN_CLOSE,		/* ) */
+	MORSE_TICK,			/* ' */
+	MORSE_EQUAL,			/* = */
+	MORSE_PLUS,			/* + */
+	MORSE_SLASH,			/* / */
+	MORSE_AT,			/* @ */
+	MORSE_SPACE,			/*   */
+
+	MORSE_SPEC_START	= MORSE_GACC_A,
+	MORSE_SPEC_END		= MORSE_SPACE,
+
+	/* Signals */
+	MORSE_SIG_KA	= 192,		/* Start */
+	MORSE_SIG_BT,			/* Pause */
+	MORSE_SIG_AR,			/* End */
+	MORSE_SIG_VE,			/* Understood */
+	MORSE_SIG_SK,			/* End of work */
+	MORSE_SIG_SOS,			/* SOS */
+	MORSE_SIG_ERROR,		/* Error */
+
+	MORSE_SIG_START		= MORSE_SIG_KA,
+	MORSE_SIG_END		= MORSE_SIG_ERROR,
+};
+
+
+/* ASCII -> morse symbol. Use MORSE_ASCII_TAB_SYM() to read entries. */
+static const morse_sym_t ascii_symbols[256] = MORSE_ASCII_TAB_INIT;
+
+/* Reverse lookup: MORSE_SYM_INDEX(symbol) -> enum morse_character */
+static const uint8_t decode_symbols[MORSE_NR_SYM_INDEXES] = MORSE_DECODE_TAB_INIT;
+
+/* Reverse lookup: MORSE_SYM_INDEX(symbol) -> ASCII. Built by tables_init(). */
+static char decode_ascii[MORSE_NR_SYM_INDEXES];
+
+/* Index into binary_ascii: The symbol size and the marks.
+ * Only valid for symbols without reserved bits and with size <= 9. */
+#define BINARY_INDEX(sym)	((((sym) >> 3) & 0x1E00) | ((sym) & 0x1FF))
+#define BINARY_NR_INDEXES	((MORSE_MAX_NR_MARKS + 1) << MORSE_MAX_NR_MARKS)
+
+/* Reverse lookup: BINARY_INDEX(symbol) -> ASCII. Built by tables_init().
+ * Entries with marks above the symbol size are 0. */
+static char binary_ascii[BINARY_NR_INDEXES];
+
+/* The fully rendered output of a morse character. */
+struct rendered_symbol {
+	/* The longest is a 9 mark ditdah symbol: "Dah" + 8 * "-dah" + " " */
+	char text[39];
+	uint8_t len;
+};
+
+/* Rendered output of every text format, indexed by the input byte */
+enum rendered_table {
+	RENDERED_DASHDOT,
+	RENDERED_DITDAH,
+	RENDERED_BINARY_LE,
+	RENDERED_BINARY_BE,
+	NR_RENDERED_TABLES,
+};
+
+static struct rendered_symbol rendered_symbols[NR_RENDERED_TABLES][256];
+/* The length of the longest rendered output of a table */
+static size_t rendered_max_len[NR_RENDERED_TABLES];
+
+/* Packed format.
+ * A bitstream of symbols, least significant bit first. Every symbol
+ * is a 4 bit size followed by its marks, first mark first.
+ * Size 0 is a space between words. Size 15 terminates the stream.
+ * The rest of the byte holding the terminator is padding.
+ */
+#define PACKED_SIZE_BITS	4
+#define PACKED_END		0xF
+
+/* The packed bits of a character */
+struct packed_code {
+	uint16_t bits;
+	uint8_t nr_bits;
+};
+
+/* Packed codes, indexed by the input byte. nr_bits is 0 for bytes
+ * that can not be encoded. */
+static struct packed_code packed_codes[256];
+
+/* Packed output bytes per input byte. A character is at most 13 bits. */
+#define PACKED_MAX_LEN		2
+
+/* Ditdah tokenizer.
+ * A DFA over the input bytes. Every entry holds the next state and the
+ * action for the byte. Looking at a byte without consuming it is folded
+ * into the table, so every byte is exactly one lookup. */
+enum ditdah_action {
+	DITDAH_NONE,
+	DITDAH_DIT,		/* "di" */
+	DITDAH_DAH,		/* "da" */
+	DITDAH_END_CHAR,	/* A space after the marks */
+	DITDAH_END_WORD,	/* Anything else */
+	DITDAH_END_WORD2,	/* A stray 'd' followed by an end of word */
+};
+
+#define DITDAH_STATE_BITS	3
+#define DITDAH_STATE_MASK	((1u << DITDAH_STATE_BITS) - 1)
+#define DITDAH_NR_STATES	(MORSE_DITDAH_SPACE + 1)
+
+/* Built by tables_init() */
+static uint8_t ditdah_dfa[DITDAH_NR_STATES][256];
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+
+static void set_error(struct morse_ctx *ctx, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(ctx->error, sizeof(ctx->error), fmt, ap);
+	va_end(ap);
+}
+
+/* The output span is always big enough. See morse_process(). */
+static inline void out_putc(struct morse_ctx *ctx, char c)
+{
+	ctx->out[ctx->out_len++] = c;
+}
+
+static enum morse_character morse_decode_symbol(morse_sym_t sym)
+{
+	unsigned int size = MORSE_SYM_SIZE(sym);
+	uint8_t mchar;
+
+	BUILD_BUG_ON(MORSE_NR_SYM_INDEXES != 1 << (MORSE_MAX_NR_MARKS + 1));
+
+	/* Reject anything with marks or reserved bits above the symbol size.
+	 * Those would alias a different entry in the lookup table. */
+	if (size > MORSE_MAX_NR_MARKS || ((sym & 0x0FFF) >> size))
+		return (enum morse_character)-1;
+	mchar = decode_symbols[MORSE_SYM_INDEX(sym)];
+	if (!mchar)
+		return (enum morse_character)-1;
+
+	return (enum morse_character)mchar;
+}
+
+static char morse_to_ascii(enum morse_character mchar)
+{
+	if ((mchar >= MORSE_CHARS_START && mchar <= MORSE_CHARS_END) ||
+	    (mchar >= MORSE_NUMS_START && mchar <= MORSE_NUMS_END))
+		return (char)mchar;
+
+	switch (mchar) {
+	case MORSE_SPACE:
+		return ' ';
+	case MORSE_PERIOD:
+		return '.';
+	case MORSE_COMMA:
+		return ',';
+	case MORSE_COLON:
+		return ':';
+	case MORSE_SEMICOLON:
+		return ';';
+	case MORSE_QUESTION:
+		return '?';
+	case MORSE_DASH:
+		return '-';
+	case MORSE_UNDERSCORE:
+		return '_';
+	case MORSE_PAREN_OPEN:
+		return '(';
+	case MORSE_PAREN_CLOSE:
+		return ')';
+	case MORSE_TICK:
+		return '\'';
+	case MORSE_EQUAL:
+		return '=';
+	case MORSE_PLUS:
+		return '+';
+	case MORSE_SLASH:
+		return '/';
+	case MORSE_AT:
+		return '@';
+	default:
+		break;
+	}
+
+	return '\0';
+}
+
+static void render_mark(struct rendered_symbol *r, const char *str)
+{
+	size_t len = strlen(str);
+
+	memcpy(&r->text[r->len], str, len);
+	r->len += len;
+}
+
+static void render_symbol(struct rendered_symbol *r, enum rendered_table table,
+			  morse_sym_t sym)
+{
+	unsigned int i;
+
+	r->len = 0;
+	switch (table) {
+	case RENDERED_DASHDOT:
+		if (MORSE_SYM_IS_SPACE(sym)) {
+			render_mark(r, "/  ");
+		} else {
+			for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
+				if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT)
+					render_mark(r, ".");
+				else
+					render_mark(r, "-");
+			}
+			render_mark(r, "  ");
+		}
+		break;
+	case RENDERED_DITDAH:
+		if (MORSE_SYM_IS_SPACE(sym)) {
+			render_mark(r, ", ");
+		} else {
+			for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
+				if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT) {
+					if (i == 0)
+						render_mark(r, "Di");
+					else if (i == MORSE_SYM_SIZE(sym) - 1)
+						render_mark(r, "-dit");
+					else
+						render_mark(r, "-di");
+				} else {
+					if (i == 0)
+						render_mark(r, "Dah");
+					else
+						render_mark(r, "-dah");
+				}
+			}
+			render_mark(r, " ");
+		}
+		break;
+	case RENDERED_BINARY_LE:
+		r->text[0] = sym & 0xFF;
+		r->text[1] = (sym >> 8) & 0xFF;
+		r->len = 2;
+		break;
+	case RENDERED_BINARY_BE:
+		r->text[0] = (sym >> 8) & 0xFF;
+		r->text[1] = sym & 0xFF;
+		r->len = 2;
+		break;
+	case NR_RENDERED_TABLES:
+		break;
+	}
+}
+
+/* Render the output text of every encodable input byte once.
+ * Bytes that can not be encoded get an empty text. */
+static void render_init(enum rendered_table table)
+{
+	struct rendered_symbol *r = rendered_symbols[table];
+	unsigned int i;
+	morse_sym_t sym;
+
+	BUILD_BUG_ON(ARRAY_SIZE(rendered_symbols[0]) != ARRAY_SIZE(ascii_symbols));
+
+	for (i = 0; i < ARRAY_SIZE(rendered_symbols[0]); i++) {
+		sym = MORSE_ASCII_TAB_SYM(ascii_symbols[i]);
+		if (sym == MORSE_SYM_INVALID)
+			continue;
+		render_symbol(&r[i], table, sym);
+		if (r[i].len > rendered_max_len[table])
+			rendered_max_len[table] = r[i].len;
+	}
+}
+
+static enum rendered_table rendered_table(const struct morse_ctx *ctx)
+{
+	if (ctx->format == MORSE_FMT_DITDAH)
+		return RENDERED_DITDAH;
+	if (ctx->format == MORSE_FMT_BINARY)
+		return (ctx->flags & MORSE_BIGENDIAN) ? RENDERED_BINARY_BE
+						      : RENDERED_BINARY_LE;
+	return RENDERED_DASHDOT;
+}
+
+/* Encode one block of text.
+ * Encoding has no state across characters, so a text may be encoded
+ * in arbitrary pieces. */
+static int morse_encode(struct morse_ctx *ctx, const char *text, size_t len)
+{
+	const struct rendered_symbol *symbols, *r;
+	const char *ascii;
+
+	symbols = rendered_symbols[rendered_table(ctx)];
+	for (ascii = text; ascii < text + len; ascii++) {
+		r = &symbols[(uint8_t)*ascii];
+		if (!r->len) {
+			set_error(ctx, "Could not translate character: %c", *ascii);
+			return -1;
+		}
+
+		/* Always copy the whole fixed size text buffer.
+		 * That is cheaper than a variable length copy. */
+		memcpy(&ctx->out[ctx->out_len], r->text, sizeof(r->text));
+		ctx->out_len += r->len;
+	}
+
+	return 0;
+}
+
+static int morse_encode_finish(struct morse_ctx *ctx)
+{
+	if (ctx->format != MORSE_FMT_BINARY)
+		out_putc(ctx, '\n');
+
+	return 0;
+}
+
+static void packed_init(void)
+{
+	unsigned int i;
+	morse_sym_t sym;
+
+	for (i = 0; i < ARRAY_SIZE(packed_codes); i++) {
+		sym = MORSE_ASCII_TAB_SYM(ascii_symbols[i]);
+		if (sym == MORSE_SYM_INVALID)
+			continue;
+		packed_codes[i].bits = (uint16_t)(MORSE_SYM_SIZE(sym) |
+				MORSE_SYM_MARKS(sym) << PACKED_SIZE_BITS);
+		packed_codes[i].nr_bits = (uint8_t)(PACKED_SIZE_BITS +
+						     MORSE_SYM_SIZE(sym));
+	}
+}
+
+static inline void packed_put(struct morse_ctx *ctx,
+			      uint16_t bits, unsigned int nr_bits)
+{
+	struct morse_packer *p = &ctx->packer;
+	char *out;
+
+	p->bits |= (uint64_t)bits << p->nr_bits;
+	p->nr_bits += nr_bits;
+	if (p->nr_bits >= 32) {
+		out = &ctx->out[ctx->out_len];
+		out[0] = (char)(p->bits);
+		out[1] = (char)(p->bits >> 8);
+		out[2] = (char)(p->bits >> 16);
+		out[3] = (char)(p->bits >> 24);
+		ctx->out_len += 4;
+		p->bits >>= 32;
+		p->nr_bits -= 32;
+	}
+}
+
+static int morse_encode_packed(struct morse_ctx *ctx,
+			       const char *text, size_t len)
+{
+	const struct packed_code *p;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		p = &packed_codes[(uint8_t)text[i]];
+		if (!p->nr_bits) {
+			set_error(ctx, "Could not translate character: %c", text[i]);
+			return -1;
+		}
+		packed_put(ctx, p->bits, p->nr_bits);
+	}
+
+	return 0;
+}
+
+static int morse_encode_packed_finish(struct morse_ctx *ctx)
+{
+	struct morse_packer *p = &ctx->packer;
+
+	packed_put(ctx, PACKED_END, PACKED_SIZE_BITS);
+	while (p->nr_bits) {
+		out_putc(ctx, (char)p->bits);
+		p->bits >>= 8;
+		p->nr_bits = p->nr_bits > 8 ? p->nr_bits - 8 : 0;
+	}
+
+	return 0;
+}
+
+static int decode_sym(struct morse_ctx *ctx, morse_sym_t sym)
+{
+	enum morse_character mchar;
+	char achar;
+
+	mchar = morse_decode_symbol(sym);
+	if (mchar == (enum morse_character)-1) {
+		set_error(ctx, "Could not decode symbol 0x%04X",
+			(uint16_t)sym);
+		return -1;
+	}
+	achar = morse_to_ascii(mchar);
+	if (!achar) {
+		set_error(ctx, "Could not decode morse char 0x%02X",
+			(uint8_t)mchar);
+		return -1;
+	}
+	out_putc(ctx, achar);
+
+	return 0;
+}
+
+static int decoder_add_mark(struct morse_ctx *ctx, enum morse_marks mark)
+{
+	ctx->decoder.marks |= (unsigned int)mark << ctx->decoder.nr_marks;
+	ctx->decoder.nr_marks++;
+	if (ctx->decoder.nr_marks > MORSE_MAX_NR_MARKS) {
+		set_error(ctx, "Too many marks");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int decoder_end_symbol(struct morse_ctx *ctx)
+{
+	unsigned int index;
+	int err = 0;
+
+	if (!ctx->decoder.nr_marks)
+		return 0;
+	index = (1u << ctx->decoder.nr_marks) | ctx->decoder.marks;
+	if (decode_ascii[index])
+		out_putc(ctx, decode_ascii[index]);
+	else /* Not decodable. Report it. */
+		err = decode_sym(ctx, __MORSE_SYM(ctx->decoder.marks,
+						  ctx->decoder.nr_marks));
+	ctx->decoder.marks = 0;
+	ctx->decoder.nr_marks = 0;
+
+	return err;
+}
+
+/* Dashdot input is classified in blocks of 32 bytes.
+ * Bit n of each mask describes input byte n. */
+#define DASHDOT_BLOCK_SIZE	32
+
+struct dashdot_block {
+	uint64_t dot;
+	uint64_t dash;
+	uint64_t space;
+};
+
+static void dashdot_classify_generic(struct dashdot_block *b,
+				     const char *input, unsigned int len)
+{
+	unsigned int i;
+	unsigned char c;
+
+	b->dot = b->dash = b->space = 0;
+	for (i = 0; i < len; i++) {
+		c = input[i];
+		if (c == '.')
+			b->dot |= 1ull << i;
+		else if (c == '-' || c == '_')
+			b->dash |= 1ull << i;
+		else if (isspace(c))
+			b->space |= 1ull << i;
+	}
+}
+
+static void dashdot_classify_block_generic(struct dashdot_block *b,
+					   const char *input)
+{
+	dashdot_classify_generic(b, input, DASHDOT_BLOCK_SIZE);
+}
+
+#ifdef __SSE2__
+/* isspace() in the C locale: ' ' and '\t' to '\r' */
+static inline __m128i sse2_isspace(__m128i v)
+{
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+
+	return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			    _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8('\r' - '\t')), t));
+}
+
+static void dashdot_classify_block_sse2(struct dashdot_block *b,
+					const char *input)
+{
+	__m128i v;
+	unsigned int i;
+
+	b->dot = b->dash = b->space = 0;
+	for (i = 0; i < DASHDOT_BLOCK_SIZE; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)&input[i]);
+		b->dot |= (uint64_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('.'))) << i;
+		b->dash |= (uint64_t)_mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('_')))) << i;
+		b->space |= (uint64_t)_mm_movemask_epi8(sse2_isspace(v)) << i;
+	}
+}
+#endif /* __SSE2__ */
+
+#ifdef HAVE_AVX2
+__attribute__((target("avx2")))
+static void dashdot_classify_block_avx2(struct dashdot_block *b,
+					const char *input)
+{
+	__m256i v, t;
+
+	BUILD_BUG_ON(DASHDOT_BLOCK_SIZE != 32);
+
+	v = _mm256_loadu_si256((const __m256i *)input);
+	t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	b->dot = (uint32_t)_mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+	b->dash = (uint32_t)_mm256_movemask_epi8(
+		_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+	b->space = (uint32_t)_mm256_movemask_epi8(
+		_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8('\r' - '\t')), t)));
+}
+#endif /* HAVE_AVX2 */
+
+static void (*dashdot_classify_block)(struct dashdot_block *b,
+				      const char *input) = dashdot_classify_block_generic;
+
+/* Decode a classified block.
+ * This walks runs of equal byte classes instead of single bytes. */
+static int dashdot_decode_block(struct morse_ctx *ctx,
+				const struct dashdot_block *b, unsigned int len)
+{
+	uint64_t mark = b->dot | b->dash;
+	unsigned int pos = 0, run;
+	int err;
+
+	while (pos < len) {
+		if ((mark >> pos) & 1) {
+			run = (unsigned int)__builtin_ctzll(~(mark >> pos));
+			if (ctx->decoder.nr_marks + run > MORSE_MAX_NR_MARKS) {
+				set_error(ctx, "Too many marks");
+				return -1;
+			}
+			/* The dash bits are the marks (dah = 1). */
+			ctx->decoder.marks |= (unsigned int)((b->dash >> pos) & ((1u << run) - 1))
+					      << ctx->decoder.nr_marks;
+			ctx->decoder.nr_marks += run;
+			pos += run;
+		} else if ((b->space >> pos) & 1) { /* end of char */
+			err = decoder_end_symbol(ctx);
+			if (err)
+				return err;
+			/* Any further spaces are no-ops. */
+			pos += (unsigned int)__builtin_ctzll(~(b->space >> pos));
+		} else { /* end of word */
+			out_putc(ctx, ' ');
+			pos++;
+		}
+	}
+
+	return 0;
+}
+
+static int morse_decode_dashdot(struct morse_ctx *ctx,
+				const char *input, size_t len)
+{
+	struct dashdot_block b;
+	int err;
+
+	for ( ; len >= DASHDOT_BLOCK_SIZE; input += DASHDOT_BLOCK_SIZE, len -= DASHDOT_BLOCK_SIZE) {
+		dashdot_classify_block(&b, input);
+		err = dashdot_decode_block(ctx, &b, DASHDOT_BLOCK_SIZE);
+		if (err)
+			return err;
+	}
+	if (len) {
+		dashdot_classify_generic(&b, input, (unsigned int)len);
+		err = dashdot_decode_block(ctx, &b, (unsigned int)len);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static uint8_t ditdah_entry(enum morse_ditdah_state state,
+			   enum ditdah_action action)
+{
+	BUILD_BUG_ON(DITDAH_NR_STATES > DITDAH_STATE_MASK + 1);
+
+	return (uint8_t)(action << DITDAH_STATE_BITS | state);
+}
+
+/* The transition at the start of a token.
+ * stray_d: A 'd' not followed by "i" or "a" came before. */
+static uint8_t ditdah_token(int c, bool stray_d)
+{
+	if (c == 'd' || c == 'D')
+		return ditdah_entry(MORSE_DITDAH_D, stray_d ? DITDAH_END_WORD
+							    : DITDAH_NONE);
+	if (isspace(c) && !stray_d)
+		return ditdah_entry(MORSE_DITDAH_TOKEN, DITDAH_END_CHAR);
+	if (isspace(c))
+		return ditdah_entry(MORSE_DITDAH_SPACE, DITDAH_END_WORD);
+	return ditdah_entry(MORSE_DITDAH_SPACE, stray_d ? DITDAH_END_WORD2
+						       : DITDAH_END_WORD);
+}
+
+static void ditdah_init(void)
+{
+	uint8_t token;
+	int c;
+
+	for (c = 0; c < 256; c++) {
+		token = ditdah_token(c, false);
+		ditdah_dfa[MORSE_DITDAH_TOKEN][c] = token;
+		if (tolower(c) == 'i')
+			ditdah_dfa[MORSE_DITDAH_D][c] = ditdah_entry(MORSE_DITDAH_ALPHA, DITDAH_DIT);
+		else if (tolower(c) == 'a')
+			ditdah_dfa[MORSE_DITDAH_D][c] = ditdah_entry(MORSE_DITDAH_ALPHA, DITDAH_DAH);
+		else
+			ditdah_dfa[MORSE_DITDAH_D][c] = ditdah_token(c, true);
+		/* The rest of "dit" or "dah", then the dashes */
+		if (isalpha(c))
+			ditdah_dfa[MORSE_DITDAH_ALPHA][c] = ditdah_entry(MORSE_DITDAH_ALPHA, DITDAH_NONE);
+		else if (c == '-')
+			ditdah_dfa[MORSE_DITDAH_ALPHA][c] = ditdah_entry(MORSE_DITDAH_DASH, DITDAH_NONE);
+		else
+			ditdah_dfa[MORSE_DITDAH_ALPHA][c] = token;
+		if (c == '-')
+			ditdah_dfa[MORSE_DITDAH_DASH][c] = ditdah_entry(MORSE_DITDAH_DASH, DITDAH_NONE);
+		else
+			ditdah_dfa[MORSE_DITDAH_DASH][c] = token;
+		if (isspace(c))
+			ditdah_dfa[MORSE_DITDAH_SPACE][c] = ditdah_entry(MORSE_DITDAH_SPACE, DITDAH_NONE);
+		else
+			ditdah_dfa[MORSE_DITDAH_SPACE][c] = token;
+	}
+}
+
+static int morse_decode_ditdah(struct morse_ctx *ctx,
+			       const char *input, size_t len)
+{
+	unsigned int state = ctx->decoder.ditdah;
+	uint8_t t;
+	size_t i;
+	int err = 0;
+
+	for (i = 0; i < len && !err; i++) {
+		t = ditdah_dfa[state][(uint8_t)input[i]];
+		state = t & DITDAH_STATE_MASK;
+		switch (t >> DITDAH_STATE_BITS) {
+		case DITDAH_NONE:
+			break;
+		case DITDAH_DIT:
+			err = decoder_add_mark(ctx, MORSE_DIT);
+			break;
+		case DITDAH_DAH:
+			err = decoder_add_mark(ctx, MORSE_DAH);
+			break;
+		case DITDAH_END_CHAR:
+			err = decoder_end_symbol(ctx);
+			break;
+		case DITDAH_END_WORD2:
+			out_putc(ctx, ' ');
+			/* fall through */
+		case DITDAH_END_WORD:
+			out_putc(ctx, ' ');
+			break;
+		}
+	}
+	ctx->decoder.ditdah = (enum morse_ditdah_state)state;
+
+	return err;
+}
+
+static int decode_binary_sym(struct morse_ctx *ctx,
+			     uint8_t first, uint8_t second)
+{
+	morse_sym_t sym;
+	char c;
+
+	if ((ctx->flags & MORSE_BIGENDIAN))
+		sym = (morse_sym_t)(first << 8 | second);
+	else
+		sym = (morse_sym_t)(first | second << 8);
+
+	if (!(sym & 0x0E00) && MORSE_SYM_SIZE(sym) <= MORSE_MAX_NR_MARKS) {
+		c = binary_ascii[BINARY_INDEX(sym)];
+		if (c) {
+			out_putc(ctx, c);
+			return 0;
+		}
+	}
+	/* Not decodable. Report it. */
+	return decode_sym(ctx, sym);
+}
+
+#ifdef __SSE2__
+/* Decode 8 binary symbols at once.
+ * Returns false, if any of the symbols can not be decoded.
+ * Nothing is output in that case. */
+static bool decode_binary_sse2(struct morse_ctx *ctx, const char *input)
+{
+	__m128i v, ok;
+	uint16_t index[8];
+	unsigned int i;
+	char *out, c;
+
+	v = _mm_loadu_si128((const __m128i *)input);
+	if ((ctx->flags & MORSE_BIGENDIAN))
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+	/* No reserved bits and size <= 9 */
+	ok = _mm_andnot_si128(
+		_mm_cmpgt_epi16(_mm_srli_epi16(v, 12),
+				_mm_set1_epi16(MORSE_MAX_NR_MARKS)),
+		_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(0x0E00)),
+				_mm_setzero_si128()));
+	if (_mm_movemask_epi8(ok) != 0xFFFF)
+		return false;
+
+	_mm_storeu_si128((__m128i *)index,
+		_mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 3),
+					   _mm_set1_epi16(0x1E00)),
+			     _mm_and_si128(v, _mm_set1_epi16(0x1FF))));
+	out = &ctx->out[ctx->out_len];
+	for (i = 0; i < ARRAY_SIZE(index); i++) {
+		c = binary_ascii[index[i]];
+		if (!c)
+			return false;
+		out[i] = c;
+	}
+	ctx->out_len += ARRAY_SIZE(index);
+
+	return true;
+}
+#endif /* __SSE2__ */
+
+static int morse_decode_binary(struct morse_ctx *ctx,
+			       const char *input, size_t len)
+{
+	size_t i = 0;
+	int err;
+
+	if (ctx->decoder.have_byte && len) {
+		/* Complete the symbol split by the previous call. */
+		err = decode_binary_sym(ctx, ctx->decoder.byte, (uint8_t)input[0]);
+		if (err)
+			return err;
+		ctx->decoder.have_byte = false;
+		i = 1;
+	}
+#ifdef __SSE2__
+	/* On failure the scalar loop takes over and reports the error. */
+	for ( ; i + 16 <= len; i += 16) {
+		if (!decode_binary_sse2(ctx, &input[i]))
+			break;
+	}
+#endif
+	for ( ; i + 1 < len; i += 2) {
+		err = decode_binary_sym(ctx, (uint8_t)input[i],
+					(uint8_t)input[i + 1]);
+		if (err)
+			return err;
+	}
+	if (i < len) {
+		ctx->decoder.byte = (uint8_t)input[i];
+		ctx->decoder.have_byte = true;
+	}
+
+	return 0;
+}
+
+static int morse_decode_packed(struct morse_ctx *ctx,
+			       const char *input, size_t len)
+{
+	unsigned int size, marks;
+	size_t i;
+	int err;
+
+	for (i = 0; i < len; i++) {
+		ctx->decoder.bits |= (uint32_t)(uint8_t)input[i] << ctx->decoder.nr_bits;
+		ctx->decoder.nr_bits += 8;
+		ctx->decoder.packed_open = true;
+
+		while (ctx->decoder.nr_bits >= PACKED_SIZE_BITS) {
+			size = ctx->decoder.bits & 0xF;
+			if (size == PACKED_END) {
+				/* Drop the padding. A new stream may follow. */
+				ctx->decoder.bits = 0;
+				ctx->decoder.nr_bits = 0;
+				ctx->decoder.packed_open = false;
+				break;
+			}
+			if (size > MORSE_MAX_NR_MARKS) {
+				set_error(ctx, "Invalid packed symbol size %u", size);
+				return -1;
+			}
+			if (ctx->decoder.nr_bits < PACKED_SIZE_BITS + size)
+				break;
+			marks = (ctx->decoder.bits >> PACKED_SIZE_BITS) & ((1u << size) - 1);
+			ctx->decoder.bits >>= PACKED_SIZE_BITS + size;
+			ctx->decoder.nr_bits -= PACKED_SIZE_BITS + size;
+
+			if (decode_ascii[(1u << size) | marks]) {
+				out_putc(ctx, decode_ascii[(1u << size) | marks]);
+			} else {
+				err = decode_sym(ctx, __MORSE_SYM(marks, size));
+				if (err)
+					return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void tables_init(void)
+{
+	unsigned int i, size, marks;
+
+	for (i = 0; i < ARRAY_SIZE(decode_ascii); i++) {
+		if (decode_symbols[i])
+			decode_ascii[i] = morse_to_ascii(decode_symbols[i]);
+	}
+	for (size = 0; size <= MORSE_MAX_NR_MARKS; size++) {
+		for (marks = 0; marks < (1u << size); marks++) {
+			binary_ascii[BINARY_INDEX(__MORSE_SYM(marks, size))] =
+				decode_ascii[MORSE_SYM_INDEX(__MORSE_SYM(marks, size))];
+		}
+	}
+	for (i = 0; i < NR_RENDERED_TABLES; i++)
+		render_init((enum rendered_table)i);
+	packed_init();
+	ditdah_init();
+
+#ifdef __SSE2__
+	dashdot_classify_block = dashdot_classify_block_sse2;
+#endif
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		dashdot_classify_block = dashdot_classify_block_avx2;
+#endif
+}
+
+/* Initialize a context. The shared lookup tables are built on first use. */
+void morse_init(struct morse_ctx *ctx, enum morse_format format,
+		unsigned int flags)
+{
+	pthread_once(&tables_once, tables_init);
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->format = format;
+	ctx->flags = flags;
+}
+
+/* The worst case number of output bytes per input byte */
+static size_t out_per_byte(const struct morse_ctx *ctx)
+{
+	if (ctx->flags & MORSE_DECODE) {
+		/* The shortest packed symbol (a space) is 4 bits.
+		 * The text formats take at least one byte per character. */
+		return ctx->format == MORSE_FMT_PACKED ? 2 : 1;
+	}
+	if (ctx->format == MORSE_FMT_PACKED)
+		return PACKED_MAX_LEN;
+
+	return rendered_max_len[rendered_table(ctx)];
+}
+
+/* The output span size needed to process in_len bytes in one call */
+size_t morse_out_bound(const struct morse_ctx *ctx, size_t in_len)
+{
+	return in_len * out_per_byte(ctx) + MORSE_OUT_SLACK;
+}
+
+/* Encode or decode a piece of input into the output span.
+ * Only as much input is consumed as fits into the output span in
+ * the worst case, so the caller loops until all input is consumed.
+ * Returns 0 on success. On error -1 is returned and ctx->error holds
+ * the message. The output produced up to the error is valid in either
+ * case. After an error the context must be initialized again.
+ */
+int morse_process(struct morse_ctx *ctx,
+		  const char *in, size_t in_len, size_t *consumed,
+		  char *out, size_t out_size, size_t *produced)
+{
+	size_t len = 0;
+	int err = -1;
+
+	if (out_size > MORSE_OUT_SLACK)
+		len = min(in_len, (out_size - MORSE_OUT_SLACK) / out_per_byte(ctx));
+	ctx->out = out;
+	ctx->out_len = 0;
+
+	if (ctx->flags & MORSE_DECODE) {
+		switch (ctx->format) {
+		case MORSE_FMT_DASHDOT:
+			err = morse_decode_dashdot(ctx, in, len);
+			break;
+		case MORSE_FMT_DITDAH:
+			err = morse_decode_ditdah(ctx, in, len);
+			break;
+		case MORSE_FMT_BINARY:
+			err = morse_decode_binary(ctx, in, len);
+			break;
+		case MORSE_FMT_PACKED:
+			err = morse_decode_packed(ctx, in, len);
+			break;
+		}
+	} else if (ctx->format == MORSE_FMT_PACKED) {
+		err = morse_encode_packed(ctx, in, len);
+	} else {
+		err = morse_encode(ctx, in, len);
+	}
+
+	*consumed = len;
+	*produced = ctx->out_len;
+
+	return err;
+}
+
+static int morse_decode_finish(struct morse_ctx *ctx)
+{
+	switch (ctx->format) {
+	case MORSE_FMT_DITDAH:
+		if (ctx->decoder.ditdah == MORSE_DITDAH_D)
+			out_putc(ctx, ' '); /* A trailing 'd' is an end of word. */
+		break;
+	case MORSE_FMT_BINARY:
+		if (ctx->decoder.have_byte) {
+			set_error(ctx, "Invalid input length (odd length)");
+			return -1;
+		}
+		break;
+	case MORSE_FMT_PACKED:
+		if (ctx->decoder.packed_open) {
+			set_error(ctx, "Truncated packed input");
+			return -1;
+		}
+		break;
+	case MORSE_FMT_DASHDOT:
+		break;
+	}
+	if (decoder_end_symbol(ctx))
+		return -1;
+	out_putc(ctx, '\n');
+
+	return 0;
+}
+
+/* Flush the end of the input. Needs MORSE_OUT_SLACK bytes of output. */
+int morse_finish(struct morse_ctx *ctx,
+		 char *out, size_t out_size, size_t *produced)
+{
+	int err;
+
+	*produced = 0;
+	if (out_size < MORSE_OUT_SLACK) {
+		set_error(ctx, "Output buffer too small");
+		return -1;
+	}
+	ctx->out = out;
+	ctx->out_len = 0;
+
+	if (ctx->flags & MORSE_DECODE)
+		err = morse_decode_finish(ctx);
+	else if (ctx->format == MORSE_FMT_PACKED)
+		err = morse_encode_packed_finish(ctx);
+	else
+		err = morse_encode_finish(ctx);
+	*produced = ctx->out_len;
+
+	return err;
+}
+
+/* Check whether the decoder behaves like a freshly initialized one.
+ * Skipping spaces after an end of word is the same as being at the
+ * start of a token, if no marks are pending.
+ * The text encoders have no state. */
+bool morse_is_initial(const struct morse_ctx *ctx)
+{
+	const struct morse_decoder *d = &ctx->decoder;
+
+	return !d->nr_marks && !d->have_byte && !d->packed_open &&
+	       (d->ditdah == MORSE_DITDAH_TOKEN || d->ditdah == MORSE_DITDAH_SPACE) &&
+	       !ctx->packer.nr_bits;
+}
+
+/* Find the last resynchronization point in a piece of decoder input.
+ * After it, the decoder most likely is back in its initial state.
+ * Returns the offset right after it or 0, if there is none. */
+size_t morse_resync(const struct morse_ctx *ctx,
+		    const char *in, size_t in_len)
+{
+	size_t i;
+
+	switch (ctx->format) {
+	case MORSE_FMT_DASHDOT:
+	case MORSE_FMT_DITDAH:
+		/* A whitespace usually ends a symbol. */
+		for (i = in_len; i > 0; i--) {
+			if (isspace((unsigned char)in[i - 1]))
+				return i;
+		}
+		break;
+	case MORSE_FMT_BINARY:
+		return in_len & ~(size_t)1;
+	case MORSE_FMT_PACKED:
+		/* Symbols are not byte aligned. */
+		break;
+	}
+
+	return 0;
+}
+
+/* ASCII -> symbol. Returns MORSE_SYM_INVALID, if there is none. */
+morse_sym_t morse_ascii_to_sym(char c)
+{
+	return MORSE_ASCII_TAB_SYM(ascii_symbols[(uint8_t)c]);
+}
+
+/* Symbol -> ASCII. Returns '\0', if there is none. */
+char morse_sym_to_ascii(morse_sym_t sym)
+{
+	enum morse_character mchar;
+
+	mchar = morse_decode_symbol(sym);
+	if (mchar == (enum morse_character)-1)
+		return '\0';
+
+	return morse_to_ascii(mchar);
+}
@@ -0,0 +1,100 @@
+#ifndef LIBMORSE_H_
+#define LIBMORSE_H_
+
+#include "util.h"
+#include "morse_encoder.h"
+
+#include <stddef.h>
+
+
+/* libmorse - Reentrant morse text encoder and decoder.
+ *
+ * All state lives in a caller owned struct morse_ctx, so any number of
+ * contexts may be used by any number of threads. The library never
+ * allocates memory. Input is consumed from, and output is written into,
+ * buffers supplied by the caller.
+ */
+
+enum morse_format {
+	MORSE_FMT_BINARY,	/* 16 bit morse_sym_t symbols */
+	MORSE_FMT_DASHDOT,	/* Human readable ".-" text */
+	MORSE_FMT_DITDAH,	/* Human readable "Di-dah" text */
+	MORSE_FMT_PACKED,	/* Variable length bitstream */
+};
+
+/* morse_init() flags */
+#define MORSE_DECODE		(1u << 0)	/* Decode instead of encode */
+#define MORSE_BIGENDIAN		(1u << 1)	/* Bigendian binary symbols */
+
+/* Output space that must always be available on top of the per input
+ * byte worst case. Also enough for everything morse_finish() writes. */
+#define MORSE_OUT_SLACK		64
+
+enum morse_ditdah_state {
+	MORSE_DITDAH_TOKEN,	/* At the start of a token */
+	MORSE_DITDAH_D,		/* Got a 'd'. Expecting "i" or "a" */
+	MORSE_DITDAH_ALPHA,	/* Skipping the rest of a "dit" or "dah" */
+	MORSE_DITDAH_DASH,	/* Skipping dashes after a "dit" or "dah" */
+	MORSE_DITDAH_SPACE,	/* Skipping spaces after an end of word */
+};
+
+/* Decoder state.
+ * This is carried over between calls, so the input may be
+ * split at any byte. */
+struct morse_decoder {
+	/* The marks of the symbol currently being received */
+	unsigned int marks;
+	/* The number of marks in the current symbol */
+	unsigned int nr_marks;
+	/* The ditdah tokenizer state */
+	enum morse_ditdah_state ditdah;
+	/* The first byte of a binary symbol split between calls */
+	uint8_t byte;
+	bool have_byte;
+	/* Pending packed format bits */
+	uint32_t bits;
+	unsigned int nr_bits;
+	/* A packed stream was started, but not terminated */
+	bool packed_open;
+};
+
+/* Packed encoder state */
+struct morse_packer {
+	/* Pending output bits */
+	uint64_t bits;
+	unsigned int nr_bits;
+};
+
+/* A morse context. This is a plain value. It may be copied in order to
+ * save and restore the complete encoder or decoder state. */
+struct morse_ctx {
+	enum morse_format format;
+	unsigned int flags;
+	struct morse_decoder decoder;
+	struct morse_packer packer;
+
+	/* The output span of the running call */
+	char *out;
+	size_t out_len;
+
+	/* Message of the last error */
+	char error[64];
+};
+
+void morse_init(struct morse_ctx *ctx, enum morse_format format,
+		unsigned int flags);
+size_t morse_out_bound(const struct morse_ctx *ctx, size_t in_len);
+int morse_process(struct morse_ctx *ctx,
+		  const char *in, size_t in_len, size_t *consumed,
+		  char *out, size_t out_size, size_t *produced);
+int morse_finish(struct morse_ctx *ctx,
+		 char *out, size_t out_size, size_t *produced);
+
+bool morse_is_initial(const struct morse_ctx *ctx);
+size_t morse_resync(const struct morse_ctx *ctx,
+		    const char *in, size_t in_len);
+
+morse_sym_t morse_ascii_to_sym(char c);
+char morse_sym_to_ascii(morse_sym_t sym);
+
+#endif /* LIBMORSE_H_ */
@@ -0,0 +1,195 @@
+#ifndef MORSE_ALPHABET_H_
+#define MORSE_ALPHABET_H_
+
+/* The morse alphabet.
+ *
+ * This is shared between the host encoder and the firmware.
+ * Every list calls x(character, symbol) once per entry, so that the includer
+ * can expand it into whatever table layout (and memory section) it needs.
+ * The includer must provide enum morse_marks and the MORSE_SYM_n()
+ * constructors before including this header, and the enum morse_character
+ * values before expanding the lists.
+ */
+
+#define MORSE_ALPHABET_CHARACTERS(x)					\
+	x(MORSE_A, MORSE_SYM_2(MORSE_DIT, MORSE_DAH))			\
+	x(MORSE_B, MORSE_SYM_4(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_C, MORSE_SYM_4(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_D, MORSE_SYM_3(MORSE_DAH, MORSE_DIT, MORSE_DIT))	\
+	x(MORSE_E, MORSE_SYM_1(MORSE_DIT))				\
+	x(MORSE_F, MORSE_SYM_4(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_G, MORSE_SYM_3(MORSE_DAH, MORSE_DAH, MORSE_DIT))	\
+	x(MORSE_H, MORSE_SYM_4(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_I, MORSE_SYM_2(MORSE_DIT, MORSE_DIT))			\
+	x(MORSE_J, MORSE_SYM_4(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_K, MORSE_SYM_3(MORSE_DAH, MORSE_DIT, MORSE_DAH))	\
+	x(MORSE_L, MORSE_SYM_4(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_M, MORSE_SYM_2(MORSE_DAH, MORSE_DAH))			\
+	x(MORSE_N, MORSE_SYM_2(MORSE_DAH, MORSE_DIT))			\
+	x(MORSE_O, MORSE_SYM_3(MORSE_DAH, MORSE_DAH, MORSE_DAH))	\
+	x(MORSE_P, MORSE_SYM_4(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_Q, MORSE_SYM_4(MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_R, MORSE_SYM_3(MORSE_DIT, MORSE_DAH, MORSE_DIT))	\
+	x(MORSE_S, MORSE_SYM_3(MORSE_DIT, MORSE_DIT, MORSE_DIT))	\
+	x(MORSE_T, MORSE_SYM_1(MORSE_DAH))				\
+	x(MORSE_U, MORSE_SYM_3(MORSE_DIT, MORSE_DIT, MORSE_DAH))	\
+	x(MORSE_V, MORSE_SYM_4(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_W, MORSE_SYM_3(MORSE_DIT, MORSE_DAH, MORSE_DAH))	\
+	x(MORSE_X, MORSE_SYM_4(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_Y, MORSE_SYM_4(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_Z, MORSE_SYM_4(MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT))
+
+#define MORSE_ALPHABET_NUMBERS(x)					\
+	x(MORSE_0, MORSE_SYM_5(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_1, MORSE_SYM_5(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_2, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_3, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_4, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_5, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_6, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_7, MORSE_SYM_5(MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_8, MORSE_SYM_5(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_9, MORSE_SYM_5(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT))
+
+#define MORSE_ALPHABET_SPECIALS(x)					\
+	x(MORSE_GACC_A, MORSE_SYM_5(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_AE, MORSE_SYM_4(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_GACC_E, MORSE_SYM_5(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_AACC_E, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_OE, MORSE_SYM_4(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_UE, MORSE_SYM_4(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_SZ, MORSE_SYM_6(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_CH, MORSE_SYM_4(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_TILDE_N, MORSE_SYM_5(MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_PERIOD, MORSE_SYM_6(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_COMMA, MORSE_SYM_6(MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH)) \
+	x(MORSE_COLON, MORSE_SYM_6(MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_SEMICOLON, MORSE_SYM_6(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_QUESTION, MORSE_SYM_6(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_DASH, MORSE_SYM_6(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_UNDERSCORE, MORSE_SYM_6(MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_PAREN_OPEN, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_PAREN_CLOSE, MORSE_SYM_6(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_TICK, MORSE_SYM_6(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_EQUAL, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_PLUS, MORSE_SYM_5(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_SLASH, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_AT, MORSE_SYM_6(MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_SPACE, 0)
+
+#define MORSE_ALPHABET_SIGNALS(x)					\
+	x(MORSE_SIG_KA, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_SIG_BT, MORSE_SYM_5(MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_SIG_AR, MORSE_SYM_5(MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_SIG_VE, MORSE_SYM_5(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DIT)) \
+	x(MORSE_SIG_SK, MORSE_SYM_6(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DIT, MORSE_DAH)) \
+	x(MORSE_SIG_SOS, MORSE_SYM_9(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DAH, MORSE_DAH, MORSE_DAH, MORSE_DIT, MORSE_DIT, MORSE_DIT)) \
+	x(MORSE_SIG_ERROR, MORSE_SYM_8(MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT, MORSE_DIT))
+
+/* Dense reverse lookup index of a morse symbol.
+ * A 1-bit is put on top of the marks, so that symbols of different
+ * size never collide: index = (1 << size) | marks
+ * This is only unique for symbols with no marks above their size
+ * and a size of at most 9 marks. The space symbol has index 1.
+ */
+#define MORSE_SYM_INDEX(symbol)		((1 << (((symbol) >> 12) & 0xF)) | ((symbol) & 0x1FF))
+#define MORSE_NR_SYM_INDEXES		(1 << (9 + 1))
+
+/* Reverse lookup table initializer.
+ * Maps MORSE_SYM_INDEX(symbol) to the enum morse_character.
+ * Unused entries are 0.
+ * Some signals share their symbol with a special character (AR is +, BT is =).
+ * Later initializers override earlier ones, so the lists are expanded
+ * in reverse order to make the characters win over the signals.
+ */
+#define __MORSE_DECODE_SYM(character, symbol)	[MORSE_SYM_INDEX(symbol)] = (character),
+#define MORSE_DECODE_TAB_INIT {					\
+		MORSE_ALPHABET_SIGNALS(__MORSE_DECODE_SYM)		\
+		MORSE_ALPHABET_SPECIALS(__MORSE_DECODE_SYM)		\
+		MORSE_ALPHABET_NUMBERS(__MORSE_DECODE_SYM)		\
+		MORSE_ALPHABET_CHARACTERS(__MORSE_DECODE_SYM)		\
+	}
+
+/* The input characters that can be encoded.
+ * Calls x(ascii, character) once per entry.
+ */
+#define MORSE_ALPHABET_ASCII(x)						\
+	x('A', MORSE_A) x('a', MORSE_A)					\
+	x('B', MORSE_B) x('b', MORSE_B)					\
+	x('C', MORSE_C) x('c', MORSE_C)					\
+	x('D', MORSE_D) x('d', MORSE_D)					\
+	x('E', MORSE_E) x('e', MORSE_E)					\
+	x('F', MORSE_F) x('f', MORSE_F)					\
+	x('G', MORSE_G) x('g', MORSE_G)					\
+	x('H', MORSE_H) x('h', MORSE_H)					\
+	x('I', MORSE_I) x('i', MORSE_I)					\
+	x('J', MORSE_J) x('j', MORSE_J)					\
+	x('K', MORSE_K) x('k', MORSE_K)					\
+	x('L', MORSE_L) x('l', MORSE_L)					\
+	x('M', MORSE_M) x('m', MORSE_M)					\
+	x('N', MORSE_N) x('n', MORSE_N)					\
+	x('O', MORSE_O) x('o', MORSE_O)					\
+	x('P', MORSE_P) x('p', MORSE_P)					\
+	x('Q', MORSE_Q) x('q', MORSE_Q)					\
+	x('R', MORSE_R) x('r', MORSE_R)					\
+	x('S', MORSE_S) x('s', MORSE_S)					\
+	x('T', MORSE_T) x('t', MORSE_T)					\
+	x('U', MORSE_U) x('u', MORSE_U)					\
+	x('V', MORSE_V) x('v', MORSE_V)					\
+	x('W', MORSE_W) x('w', MORSE_W)					\
+	x('X', MORSE_X) x('x', MORSE_X)					\
+	x('Y', MORSE_Y) x('y', MORSE_Y)					\
+	x('Z', MORSE_Z) x('z', MORSE_Z)					\
+	x('0', MORSE_0)							\
+	x('1', MORSE_1)							\
+	x('2', MORSE_2)							\
+	x('3', MORSE_3)							\
+	x('4', MORSE_4)							\
+	x('5', MORSE_5)							\
+	x('6', MORSE_6)							\
+	x('7', MORSE_7)							\
+	x('8', MORSE_8)							\
+	x('9', MORSE_9)							\
+	x(' ', MORSE_SPACE)						\
+	x('\t', MORSE_SPACE)						\
+	x('\n', MORSE_SPACE)						\
+	x('.', MORSE_PERIOD)						\
+	x(',', MORSE_COMMA)						\
+	x(':', MORSE_COLON)						\
+	x(';', MORSE_SEMICOLON)						\
+	x('?', MORSE_QUESTION)						\
+	x('-', MORSE_DASH)						\
+	x('_', MORSE_UNDERSCORE)					\
+	x('(', MORSE_PAREN_OPEN)					\
+	x(')', MORSE_PAREN_CLOSE)					\
+	x('\'', MORSE_TICK)						\
+	x('=', MORSE_EQUAL)						\
+	x('+', MORSE_PLUS)						\
+	x('/', MORSE_SLASH)						\
+	x('@', MORSE_AT)
+
+/* Symbol constants: MORSE_A_SYM, MORSE_0_SYM, MORSE_PERIOD_SYM, ...
+ * The signals are left out. They are not needed here and
+ * the long ones do not fit into a 16 bit int.
+ */
+#define __MORSE_SYM_CONST(character, symbol)	character##_SYM = (symbol),
+enum morse_alphabet_symbols {
+	MORSE_ALPHABET_CHARACTERS(__MORSE_SYM_CONST)
+	MORSE_ALPHABET_NUMBERS(__MORSE_SYM_CONST)
+	MORSE_ALPHABET_SPECIALS(__MORSE_SYM_CONST)
+};
+
+/* Returned for bytes that can not be encoded.
+ * This can never be a valid symbol, because the size is too big. */
+#define MORSE_SYM_INVALID		((morse_sym_t)0xFFFF)
+
+/* ASCII to morse symbol lookup table initializer for a 256 entry table.
+ * The symbols are stored inverted, so that all bytes not listed
+ * (and thus zero-initialized) read back as MORSE_SYM_INVALID.
+ * Use MORSE_ASCII_TAB_SYM() to convert an entry back to the symbol.
+ */
+#define __MORSE_ASCII_SYM(ascii, character)	[(unsigned char)(ascii)] = (morse_sym_t)~(character##_SYM),
+#define MORSE_ASCII_TAB_INIT { MORSE_ALPHABET_ASCII(__MORSE_ASCII_SYM) }
+#define MORSE_ASCII_TAB_SYM(entry)	((morse_sym_t)~(entry))
+
+#endif /* MORSE_ALPHABET_H_ */
@@ -0,0 +1,145 @@
+#ifndef MORSE_CONSTEXPR_H_
+#define MORSE_CONSTEXPR_H_
+
+/* Compile time encoding of string literals. C++11.
+ *
+ *   static const auto EEMEM beacon = MORSE_SYMS("CQ DE DL0XYZ");
+ *     beacon.sym[] is a morse_sym_t per character (morse_encoder -B).
+ *   static const auto PROGMEM beacon = MORSE_PACKED("CQ DE DL0XYZ");
+ *     beacon.byte[] is the packed bitstream (morse_encoder -P).
+ *
+ * Nothing of this exists at runtime. There is no lookup table, and
+ * a character that can not be encoded fails the build with a
+ * static_assert. The error message names its index as
+ * "invalid = N" in the instantiation of morse::checked<>.
+ *
+ * No C++ library is needed, so this works with avr-g++.
+ * The string is walked recursively, one level per character. Long
+ * strings may need a larger -fconstexpr-depth.
+ */
+
+#ifndef __cplusplus
+# error "morse_constexpr.h is C++ only"
+#endif
+
+#include "morse_encoder.h"
+#include "morse_alphabet.h"
+
+
+namespace morse {
+
+/* ASCII -> symbol. MORSE_SYM_INVALID, if there is none. */
+#define __MORSE_CONSTEXPR_SYM(ascii, character) \
+	c == (ascii) ? (morse_sym_t)(character##_SYM) :
+constexpr morse_sym_t sym(char c)
+{
+	return MORSE_ALPHABET_ASCII(__MORSE_CONSTEXPR_SYM) MORSE_SYM_INVALID;
+}
+#undef __MORSE_CONSTEXPR_SYM
+
+/* The index of the first character that can not be encoded or -1 */
+constexpr int first_invalid(const char *s, int i = 0)
+{
+	return !s[i] ? -1 :
+	       sym(s[i]) == MORSE_SYM_INVALID ? i :
+	       first_invalid(s, i + 1);
+}
+
+template <int invalid, typename T>
+constexpr T checked(T value)
+{
+	static_assert(invalid < 0, "Could not translate character "
+		      "number 'invalid'");
+	return value;
+}
+
+/* Index sequence 0 ... N-1 */
+template <unsigned int... I>
+struct indexes {};
+
+template <unsigned int N, unsigned int... I>
+struct make_indexes : make_indexes<N - 1, N - 1, I...> {};
+
+template <unsigned int... I>
+struct make_indexes<0, I...> {
+	typedef indexes<I...> type;
+};
+
+/* Symbols in the binary format */
+template <unsigned int N>
+struct symbols {
+	morse_sym_t sym[N];
+};
+
+template <unsigned int N, unsigned int... I>
+constexpr symbols<N - 1> encode(const char (&s)[N], indexes<I...>)
+{
+	return symbols<N - 1>{ { sym(s[I])... } };
+}
+
+template <unsigned int N>
+constexpr symbols<N - 1> encode(const char (&s)[N])
+{
+	static_assert(N > 1, "Empty string");
+	return encode(s, typename make_indexes<N - 1>::type());
+}
+
+/* Packed format. See libmorse.c.
+ * Every symbol is a 4 bit size followed by its marks, least significant
+ * bit first. A size of 15 terminates the stream. */
+constexpr unsigned int packed_nr_bits(morse_sym_t sym)
+{
+	return 4 + MORSE_SYM_SIZE(sym);
+}
+
+constexpr uint16_t packed_code(morse_sym_t sym)
+{
+	return (uint16_t)(MORSE_SYM_SIZE(sym) | MORSE_SYM_MARKS(sym) << 4);
+}
+
+constexpr unsigned int packed_size(const char *s, unsigned int bits = 0)
+{
+	return *s ? packed_size(s + 1, bits + packed_nr_bits(sym(*s)))
+		  : (bits + 4 + 7) / 8;
+}
+
+/* The bits of a code at bit position pos, that fall into byte k */
+constexpr uint8_t packed_part(uint16_t code, unsigned int nr_bits,
+			      unsigned int pos, unsigned int k)
+{
+	return pos >= k * 8 + 8 || pos + nr_bits <= k * 8 ? 0 :
+	       pos >= k * 8 ? (uint8_t)(code << (pos - k * 8)) :
+	       (uint8_t)(code >> (k * 8 - pos));
+}
+
+/* Byte k of the stream. The first character starts at bit position pos. */
+constexpr uint8_t packed_byte(const char *s, unsigned int k, unsigned int pos = 0)
+{
+	return pos >= k * 8 + 8 ? 0 :
+	       !*s ? packed_part(0xF, 4, pos, k) :
+	       (uint8_t)(packed_part(packed_code(sym(*s)),
+				     packed_nr_bits(sym(*s)), pos, k) |
+			 packed_byte(s + 1, k, pos + packed_nr_bits(sym(*s))));
+}
+
+template <unsigned int N>
+struct packed {
+	uint8_t byte[N];
+};
+
+template <unsigned int... I>
+constexpr packed<sizeof...(I)> pack(const char *s, indexes<I...>)
+{
+	return packed<sizeof...(I)>{ { packed_byte(s, I)... } };
+}
+
+} /* namespace morse */
+
+#define MORSE_SYMS(str) \
+	(morse::checked< morse::first_invalid(str) >(morse::encode(str)))
+
+#define MORSE_PACKED(str) \
+	(morse::checked< morse::first_invalid(str) >( \
+		morse::pack(str, morse::make_indexes< morse::packed_size(str) >::type())))
+
+#endif /* MORSE_CONSTEXPR_H_ */
@@ -20,18 +20,41 @@
 
 #include "util.h"
 #include "morse_encoder.h"
+#include "libmorse.h"
+#include "morse_alphabet.h"
+#include "morse_timing.h"
+#include "audio.h"
+#include "keying.h"
+#include "skimmer.h"
+#include "server.h"
+#include "batch.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 
 
+/* Size of the blocks read from the input stream. */
+#define STREAM_BLOCK_SIZE	(64 * 1024)
+/* Size of the input chunks processed by one worker thread. */
+#define PARALLEL_CHUNK_SIZE	(256 * 1024)
+/* Upper limit for the number of worker threads */
+#define MAX_NR_JOBS		1024
+
 enum morse_encoding {
 	ENC_BINARY,
 	ENC_DASHDOT,
 	ENC_DITDAH,
+	ENC_PACKED,
+	ENC_TRACE,		/* Key timing trace. Decode only. */
+	ENC_TRACE_VARINT,	/* Binary key timing trace. Decode only. */
 };
 
 static int syms_bigendian;
@@ -39,596 +62,849 @@ static int decode;
 static enum morse_encoding morse_encoding = ENC_DASHDOT;
 static char *input_text;
 static size_t input_text_len;
+static unsigned int nr_jobs = 1;
+static const char *listen_path;
+/* Batch mode. The arguments are files and directories. */
+static bool batch;
+static char **batch_paths;
+static unsigned int nr_batch_paths;
+
+enum audio_format {
+	AUDIO_NONE,		/* Text or symbol output */
+	AUDIO_PCM,		/* Raw signed 16 bit little endian mono */
+	AUDIO_WAV,		/* PCM with WAV header */
+};
 
-
-/* The morse alphabet */
-enum morse_character {
-	/* Characters */
-	MORSE_A		= 'A',
-	MORSE_B		= 'B',
-	MORSE_C		= 'C',
-	MORSE_D		= 'D',
-	MORSE_E		= 'E',
-	MORSE_F		= 'F',
-	MORSE_G		= 'G',
-	MORSE_H		= 'H',
-	MORSE_I		= 'I',
-	MORSE_J		= 'J',
-	MORSE_K		= 'K',
-	MORSE_L		= 'L',
-	MORSE_M		= 'M',
-	MORSE_N		= 'N',
-	MORSE_O		= 'O',
-	MORSE_P		= 'P',
-	MORSE_Q		= 'Q',
-	MORSE_R		= 'R',
-	MORSE_S		= 'S',
-	MORSE_T		= 'T',
-	MORSE_U		= 'U',
-	MORSE_V		= 'V',
-	MORSE_W		= 'W',
-	MORSE_X		= 'X',
-	MORSE_Y		= 'Y',
-	MORSE_Z		= 'Z',
-
-	MORSE_CHARS_START	= MORSE_A,
-	MORSE_CHARS_END		= MORSE_Z,
-
-	/* Numbers */
-	MORSE_0		= '0',
-	MORSE_1		= '1',
-	MORSE_2		= '2',
-	MORSE_3		= '3',
-	MORSE_4		= '4',
-	MORSE_5		= '5',
-	MORSE_6		= '6',
-	MORSE_7		= '7',
-	MORSE_8		= '8',
-	MORSE_9		= '9',
-
-	MORSE_NUMS_START	= MORSE_0,
-	MORSE_NUMS_END		= MORSE_9,
-
-	/* Special characters */
-	MORSE_GACC_A	= 128,		/* grave accent A */
-	MORSE_AE,			/* Ä */
-	MORSE_GACC_E,			/* grave accent E */
-	MORSE_AACC_E,			/* acute accent E */
-	MORSE_OE,			/* Ö */
-	MORSE_UE,			/* Ü */
-	MORSE_SZ,			/* ß */
-	MORSE_CH,			/* CH */
-	MORSE_TILDE_N,			/* tilde N */
-	MORSE_PERIOD,			/* . */
-	MORSE_COMMA,			/* , */
-	MORSE_COLON,			/* : */
-	MORSE_SEMICOLON,		/* ; */
-	MORSE_QUESTION,			/* ? */
-	MORSE_DASH,			/* - */
-	MORSE_UNDERSCORE,		/* _ */
-	MORSE_PAREN_OPEN,		/* ( */
-	MORSE_PAREN_CLOSE,		/* ) */
-	MORSE_TICK,			/* ' */
-	MORSE_EQUAL,			/* = */
-	MORSE_PLUS,			/* + */
-	MORSE_SLASH,			/* / */
-	MORSE_AT,			/* @ */
-	MORSE_SPACE,			/*   */
-
-	MORSE_SPEC_START	= MORSE_GACC_A,
-	MORSE_SPEC_END		= MORSE_SPACE,
-
-	/* Signals */
-	MORSE_SIG_KA	= 192,		/* Start */
-	MORSE_SIG_BT,			/* Pause */
-	MORSE_SIG_AR,			/* End */
-	MORSE_SIG_VE,			/* Understood */
-	MORSE_SIG_SK,			/* End of work */
-	MORSE_SIG_SOS,			/* SOS */
-	MORSE_SIG_ERROR,		/* Error */
-
-	MORSE_SIG_START		= MORSE_SIG_KA,
-	MORSE_SIG_END		= MORSE_SIG_ERROR,
+static enum audio_format audio_format;
+static unsigned int audio_wpm = 20;
+static unsigned int audio_freq = 700;
+static unsigned int audio_rate = 8000;
+static struct tone_blocks tones;
+/* Number of PCM data bytes written */
+static uint64_t audio_size;
+/* Output offset of the WAV header. -1 if it can not be updated. */
+static off_t wav_start = -1;
+
+/* Decode audio input */
+static bool audio_input;
+/* Decode all signals in the audio input */
+static bool skim;
+
+/* Audio input decoder state */
+static struct {
+	struct wav_reader wav;
+	struct tone_detector detector;
+	struct key_decoder keys;
+	/* Instead of the detector, if skim is set */
+	struct skimmer skimmer;
+	/* The first byte of a sample split between chunks */
+	char byte;
+	bool have_byte;
+} audio_in;
+
+/* Output buffer.
+ * All regular output is collected here and written out in large blocks. */
+struct output_buffer {
+	char *buf;
+	size_t len;
+	size_t size;
 };
 
+static char stdout_buf[256 * 1024];
+static struct output_buffer output;
 
-#define dit	MORSE_DIT
-#define dah	MORSE_DAH
-
-#define CHAR_SYM(character, symbol)	[(character) - MORSE_CHARS_START] = symbol
-#define NUM_SYM(number, symbol)		[(number) - MORSE_NUMS_START] = symbol
-#define SPEC_SYM(spec, symbol)		[(spec) - MORSE_SPEC_START] = symbol
-#define SIG_SYM(signal, symbol)		[(signal) - MORSE_SIG_START] = symbol
-
-static const morse_sym_t character_symbols[] = {
-	CHAR_SYM(MORSE_A, MORSE_SYM_2(dit, dah)),
-	CHAR_SYM(MORSE_B, MORSE_SYM_4(dah, dit, dit, dit)),
-	CHAR_SYM(MORSE_C, MORSE_SYM_4(dah, dit, dah, dit)),
-	CHAR_SYM(MORSE_D, MORSE_SYM_3(dah, dit, dit)),
-	CHAR_SYM(MORSE_E, MORSE_SYM_1(dit)),
-	CHAR_SYM(MORSE_F, MORSE_SYM_4(dit, dit, dah, dit)),
-	CHAR_SYM(MORSE_G, MORSE_SYM_3(dah, dah, dit)),
-	CHAR_SYM(MORSE_H, MORSE_SYM_4(dit, dit, dit, dit)),
-	CHAR_SYM(MORSE_I, MORSE_SYM_2(dit, dit)),
-	CHAR_SYM(MORSE_J, MORSE_SYM_4(dit, dah, dah, dah)),
-	CHAR_SYM(MORSE_K, MORSE_SYM_3(dah, dit, dah)),
-	CHAR_SYM(MORSE_L, MORSE_SYM_4(dit, dah, dit, dit)),
-	CHAR_SYM(MORSE_M, MORSE_SYM_2(dah, dah)),
-	CHAR_SYM(MORSE_N, MORSE_SYM_2(dah, dit)),
-	CHAR_SYM(MORSE_O, MORSE_SYM_3(dah, dah, dah)),
-	CHAR_SYM(MORSE_P, MORSE_SYM_4(dit, dah, dah, dit)),
-	CHAR_SYM(MORSE_Q, MORSE_SYM_4(dah, dah, dit, dah)),
-	CHAR_SYM(MORSE_R, MORSE_SYM_3(dit, dah, dit)),
-	CHAR_SYM(MORSE_S, MORSE_SYM_3(dit, dit, dit)),
-	CHAR_SYM(MORSE_T, MORSE_SYM_1(dah)),
-	CHAR_SYM(MORSE_U, MORSE_SYM_3(dit, dit, dah)),
-	CHAR_SYM(MORSE_V, MORSE_SYM_4(dit, dit, dit, dah)),
-	CHAR_SYM(MORSE_W, MORSE_SYM_3(dit, dah, dah)),
-	CHAR_SYM(MORSE_X, MORSE_SYM_4(dah, dit, dit, dah)),
-	CHAR_SYM(MORSE_Y, MORSE_SYM_4(dah, dit, dah, dah)),
-	CHAR_SYM(MORSE_Z, MORSE_SYM_4(dah, dah, dit, dit)),
-};
+/* The libmorse context of the text formats */
+static struct morse_ctx morse;
 
-static const morse_sym_t number_symbols[] = {
-	NUM_SYM(MORSE_0, MORSE_SYM_5(dah, dah, dah, dah, dah)),
-	NUM_SYM(MORSE_1, MORSE_SYM_5(dit, dah, dah, dah, dah)),
-	NUM_SYM(MORSE_2, MORSE_SYM_5(dit, dit, dah, dah, dah)),
-	NUM_SYM(MORSE_3, MORSE_SYM_5(dit, dit, dit, dah, dah)),
-	NUM_SYM(MORSE_4, MORSE_SYM_5(dit, dit, dit, dit, dah)),
-	NUM_SYM(MORSE_5, MORSE_SYM_5(dit, dit, dit, dit, dit)),
-	NUM_SYM(MORSE_6, MORSE_SYM_5(dah, dit, dit, dit, dit)),
-	NUM_SYM(MORSE_7, MORSE_SYM_5(dah, dah, dit, dit, dit)),
-	NUM_SYM(MORSE_8, MORSE_SYM_5(dah, dah, dah, dit, dit)),
-	NUM_SYM(MORSE_9, MORSE_SYM_5(dah, dah, dah, dah, dit)),
-};
 
-static const morse_sym_t special_symbols[] = {
-	SPEC_SYM(MORSE_GACC_A, MORSE_SYM_5(dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_AE, MORSE_SYM_4(dit, dah, dit, dah)),
-	SPEC_SYM(MORSE_GACC_E, MORSE_SYM_5(dit, dah, dit, dit, dah)),
-	SPEC_SYM(MORSE_AACC_E, MORSE_SYM_5(dit, dit, dah, dit, dit)),
-	SPEC_SYM(MORSE_OE, MORSE_SYM_4(dah, dah, dah, dit)),
-	SPEC_SYM(MORSE_UE, MORSE_SYM_4(dit, dit, dah, dah)),
-	SPEC_SYM(MORSE_SZ, MORSE_SYM_6(dit, dit, dit, dah, dah, dit)),
-	SPEC_SYM(MORSE_CH, MORSE_SYM_4(dah, dah, dah, dah)),
-	SPEC_SYM(MORSE_TILDE_N, MORSE_SYM_5(dah, dah, dit, dah, dah)),
-	SPEC_SYM(MORSE_PERIOD, MORSE_SYM_6(dit, dah, dit, dah, dit, dah)),
-	SPEC_SYM(MORSE_COMMA, MORSE_SYM_6(dah, dah, dit, dit, dah, dah)),
-	SPEC_SYM(MORSE_COLON, MORSE_SYM_6(dah, dah, dah, dit, dit, dit)),
-	SPEC_SYM(MORSE_SEMICOLON, MORSE_SYM_6(dah, dit, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_QUESTION, MORSE_SYM_6(dit, dit, dah, dah, dit, dit)),
-	SPEC_SYM(MORSE_DASH, MORSE_SYM_6(dah, dit, dit, dit, dit, dah)),
-	SPEC_SYM(MORSE_UNDERSCORE, MORSE_SYM_6(dit, dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_PAREN_OPEN, MORSE_SYM_5(dah, dit, dah, dah, dit)),
-	SPEC_SYM(MORSE_PAREN_CLOSE, MORSE_SYM_6(dah, dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_TICK, MORSE_SYM_6(dit, dah, dah, dah, dah, dit)),
-	SPEC_SYM(MORSE_EQUAL, MORSE_SYM_5(dah, dit, dit, dit, dah)),
-	SPEC_SYM(MORSE_PLUS, MORSE_SYM_5(dit, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_SLASH, MORSE_SYM_5(dah, dit, dit, dah, dit)),
-	SPEC_SYM(MORSE_AT, MORSE_SYM_6(dit, dah, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_SPACE, 0),
-};
+static void * checked_realloc(void *buf, size_t size)
+{
+	buf = realloc(buf, size);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
 
-static const morse_sym_t signal_symbols[] = {
-	SIG_SYM(MORSE_SIG_KA, MORSE_SYM_5(dah, dit, dah, dit, dah)),
-	SIG_SYM(MORSE_SIG_BT, MORSE_SYM_5(dah, dit, dit, dit, dah)),
-	SIG_SYM(MORSE_SIG_AR, MORSE_SYM_5(dit, dah, dit, dah, dit)),
-	SIG_SYM(MORSE_SIG_VE, MORSE_SYM_5(dit, dit, dit, dah, dit)),
-	SIG_SYM(MORSE_SIG_SK, MORSE_SYM_6(dit, dit, dit, dah, dit, dah)),
-	SIG_SYM(MORSE_SIG_SOS, MORSE_SYM_9(dit, dit, dit, dah, dah, dah, dit, dit, dit)),
-	SIG_SYM(MORSE_SIG_ERROR, MORSE_SYM_8(dit, dit, dit, dit, dit, dit, dit, dit)),
-};
+	return buf;
+}
 
+static void write_stdout(const char *buf, size_t len)
+{
+	ssize_t res;
+
+	while (len) {
+		res = write(STDOUT_FILENO, buf, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Failed to write output: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+		buf += res;
+		len -= (size_t)res;
+	}
+}
 
-static morse_sym_t morse_encode_character(enum morse_character c)
+static void output_flush(void)
 {
-	BUILD_BUG_ON(ARRAY_SIZE(character_symbols) != MORSE_CHARS_END - MORSE_CHARS_START + 1);
-	BUILD_BUG_ON(ARRAY_SIZE(number_symbols) != MORSE_NUMS_END - MORSE_NUMS_START + 1);
-	BUILD_BUG_ON(ARRAY_SIZE(special_symbols) != MORSE_SPEC_END - MORSE_SPEC_START + 1);
-	BUILD_BUG_ON(ARRAY_SIZE(signal_symbols) != MORSE_SIG_END - MORSE_SIG_START + 1);
+	write_stdout(output.buf, output.len);
+	output.len = 0;
+}
 
-	if (c >= MORSE_CHARS_START && c <= MORSE_CHARS_END)
-		return character_symbols[c - MORSE_CHARS_START];
-	if (c >= MORSE_NUMS_START && c <= MORSE_NUMS_END)
-		return number_symbols[c - MORSE_NUMS_START];
-	if (c >= MORSE_SPEC_START && c <= MORSE_SPEC_END)
-		return special_symbols[c - MORSE_SPEC_START];
-	if (c >= MORSE_SIG_START && c <= MORSE_SIG_END)
-		return signal_symbols[c - MORSE_SIG_START];
+/* Make room for at least len more bytes in the output buffer. */
+static inline char * output_reserve(size_t len)
+{
+	if (output.len + len > output.size)
+		output_flush();
+	return &output.buf[output.len];
+}
 
-	return signal_symbols[MORSE_SIG_ERROR - MORSE_SIG_START];
+static inline void output_putc(char c)
+{
+	*output_reserve(1) = c;
+	output.len++;
 }
 
-static enum morse_character morse_decode_symbol(morse_sym_t sym)
+static void output_write(const char *buf, size_t len)
 {
-	unsigned int i;
+	size_t count;
+
+	while (len) {
+		if (output.len == output.size)
+			output_flush();
+		count = output.size - output.len;
+		if (count > len)
+			count = len;
+		memcpy(&output.buf[output.len], buf, count);
+		output.len += count;
+		buf += count;
+		len -= count;
+	}
+}
 
-#define check_decode_tab(table, startchar) \
-		for (i = 0; i < ARRAY_SIZE(table); i++) {			\
-			if (table[i] == sym)					\
-				return (enum morse_character)(i + startchar);	\
-		}
+/* Audio output.
+ * The symbols are assembled from pre-rendered dit, dah and gap blocks.
+ * A gap of one dit follows every mark. The gaps up to the inter character
+ * and inter word lengths are appended after the character and the space.
+ */
+static int audio_init(void)
+{
+	char hdr[WAV_HEADER_SIZE];
 
-	check_decode_tab(character_symbols, MORSE_CHARS_START)
-	check_decode_tab(number_symbols, MORSE_NUMS_START)
-	check_decode_tab(special_symbols, MORSE_SPEC_START)
-	check_decode_tab(signal_symbols, MORSE_SIG_START)
-
-#undef check_decode_tab
-
-	return (enum morse_character)-1;
-}
-
-static enum morse_character ascii_to_morse(char ascii_char)
-{
-	if (ascii_char >= 'a' && ascii_char <= 'z')
-		return MORSE_A + (ascii_char - 'a');
-	if (ascii_char >= 'A' && ascii_char <= 'Z')
-		return MORSE_A + (ascii_char - 'A');
-	if (ascii_char >= '0' && ascii_char <= '9')
-		return MORSE_0 + (ascii_char - '0');
-
-	switch (ascii_char) {
-	case ' ':
-	case '\t':
-	case '\n':
-		return MORSE_SPACE;
-	case '.':
-		return MORSE_PERIOD;
-	case ',':
-		return MORSE_COMMA;
-	case ':':
-		return MORSE_COLON;
-	case ';':
-		return MORSE_SEMICOLON;
-	case '?':
-		return MORSE_QUESTION;
-	case '-':
-		return MORSE_DASH;
-	case '_':
-		return MORSE_UNDERSCORE;
-	case '(':
-		return MORSE_PAREN_OPEN;
-	case ')':
-		return MORSE_PAREN_CLOSE;
-	case '\'':
-		return MORSE_TICK;
-	case '=':
-		return MORSE_EQUAL;
-	case '+':
-		return MORSE_PLUS;
-	case '/':
-		return MORSE_SLASH;
-	case '@':
-		return MORSE_AT;
-	}
-
-	return MORSE_SIG_ERROR;
-}
-
-static char morse_to_ascii(enum morse_character mchar)
-{
-	if ((mchar >= MORSE_CHARS_START && mchar <= MORSE_CHARS_END) ||
-	    (mchar >= MORSE_NUMS_START && mchar <= MORSE_NUMS_END))
-		return (char)mchar;
-
-	switch (mchar) {
-	case MORSE_SPACE:
-		return ' ';
-	case MORSE_PERIOD:
-		return '.';
-	case MORSE_COMMA:
-		return ',';
-	case MORSE_COLON:
-		return ':';
-	case MORSE_SEMICOLON:
-		return ';';
-	case MORSE_QUESTION:
-		return '?';
-	case MORSE_DASH:
-		return '-';
-	case MORSE_UNDERSCORE:
-		return '_';
-	case MORSE_PAREN_OPEN:
-		return '(';
-	case MORSE_PAREN_CLOSE:
-		return ')';
-	case MORSE_TICK:
-		return '\'';
-	case MORSE_EQUAL:
-		return '=';
-	case MORSE_PLUS:
-		return '+';
-	case MORSE_SLASH:
-		return '/';
-	case MORSE_AT:
-		return '@';
-	default:
-		break;
+	if (tone_blocks_init(&tones, audio_rate, audio_freq, audio_wpm)) {
+		fprintf(stderr, "Failed to render the audio tones\n");
+		return -1;
+	}
+	if (audio_format == AUDIO_WAV) {
+		/* The size is not known yet. It is fixed up at the end,
+		 * if the output is seekable. */
+		wav_start = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+		if (fcntl(STDOUT_FILENO, F_GETFL) & O_APPEND)
+			wav_start = -1;
+		wav_header(hdr, audio_rate, UINT32_MAX);
+		output_write(hdr, sizeof(hdr));
 	}
 
-	return '\0';
+	return 0;
+}
+
+static void audio_put(const char *block, size_t size, unsigned int count)
+{
+	while (count--) {
+		output_write(block, size);
+		audio_size += size;
+	}
 }
 
-static int morse_encode(void)
+static int morse_encode_audio(const char *text, size_t len)
 {
-	const char *ascii;
-	enum morse_character morse;
 	morse_sym_t sym;
 	unsigned int i;
+	size_t pos;
 
-	for (ascii = input_text; *ascii; ascii++) {
-		morse = ascii_to_morse(*ascii);
-		if (morse == MORSE_SIG_ERROR) {
-			fprintf(stderr, "Could not translate character: %c\n", *ascii);
+	for (pos = 0; pos < len; pos++) {
+		sym = morse_ascii_to_sym(text[pos]);
+		if (sym == MORSE_SYM_INVALID) {
+			fprintf(stderr, "Could not translate character: %c\n", text[pos]);
 			return -1;
 		}
-		sym = morse_encode_character(morse);
-
-		switch (morse_encoding) {
-		case ENC_DASHDOT:
-			if (MORSE_SYM_IS_SPACE(sym)) {
-				printf("/  ");
-			} else {
-				for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
-					if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT)
-						putchar('.');
-					else
-						putchar('-');
-				}
-				putchar(' ');
-				putchar(' ');
-			}
-			break;
-		case ENC_DITDAH:
-			if (MORSE_SYM_IS_SPACE(sym)) {
-				printf(", ");
-			} else {
-				for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
-					if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT) {
-						if (i == 0)
-							printf("Di");
-						else if (i == MORSE_SYM_SIZE(sym) - 1)
-							printf("-dit");
-						else
-							printf("-di");
-					} else {
-						if (i == 0)
-							printf("Dah");
-						else
-							printf("-dah");
-					}
-				}
-				putchar(' ');
-			}
-			break;
-		case ENC_BINARY:
-			if (syms_bigendian) {
-				putchar((sym >> 8) & 0xFF);
-				putchar(sym & 0xFF);
-			} else {
-				putchar(sym & 0xFF);
-				putchar((sym >> 8) & 0xFF);
-			}
-			break;
+		if (MORSE_SYM_IS_SPACE(sym)) {
+			audio_put(tones.gap, tones.gap_size,
+				  FACTOR_INTER_WORD - FACTOR_INTER_CHAR);
+			continue;
+		}
+		for (i = 0; i < MORSE_SYM_SIZE(sym); i++) {
+			if (((MORSE_SYM_MARKS(sym) >> i) & 1) == MORSE_DIT)
+				audio_put(tones.dit, tones.dit_size, 1);
+			else
+				audio_put(tones.dah, tones.dah_size, 1);
+			audio_put(tones.gap, tones.gap_size, FACTOR_INTER_MARK);
 		}
+		audio_put(tones.gap, tones.gap_size,
+			  FACTOR_INTER_CHAR - FACTOR_INTER_MARK);
 	}
-	if (morse_encoding != ENC_BINARY)
-		putchar('\n');
 
 	return 0;
 }
 
-static int decode_marks(unsigned int marks, unsigned int size)
+static int morse_encode_audio_finish(void)
 {
-	morse_sym_t sym;
-	enum morse_character mchar;
-	char achar;
-
-	sym = __MORSE_SYM(marks, size);
-	mchar = morse_decode_symbol(sym);
-	if (mchar == (enum morse_character)-1) {
-		fprintf(stderr, "Could not decode symbol 0x%04X\n",
-			(uint16_t)sym);
-		return -1;
+	char hdr[WAV_HEADER_SIZE];
+	ssize_t res;
+
+	if (audio_format == AUDIO_WAV && wav_start >= 0 &&
+	    audio_size <= UINT32_MAX - WAV_HEADER_SIZE) {
+		output_flush();
+		wav_header(hdr, audio_rate, (uint32_t)audio_size);
+		res = pwrite(STDOUT_FILENO, hdr, sizeof(hdr), wav_start);
+		if (res != (ssize_t)sizeof(hdr))
+			fprintf(stderr, "Failed to update the WAV header\n");
 	}
-	achar = morse_to_ascii(mchar);
-	if (!achar) {
-		fprintf(stderr, "Could not decode morse char 0x%02X\n",
-			(uint8_t)mchar);
+	tone_blocks_free(&tones);
+
+	return 0;
+}
+
+/* Audio input.
+ * The tone detector makes one key decision per block. The runs of equal
+ * decisions are fed into the key timing decoder as marks and gaps.
+ */
+#define AUDIO_BLOCKS_PER_DIT	4
+/* The speed tracking range. Twice to a quarter of --wpm. */
+#define AUDIO_DIT_MIN		(AUDIO_BLOCKS_PER_DIT / 2)
+#define AUDIO_DIT_MAX		(AUDIO_BLOCKS_PER_DIT * 4)
+
+/* Convert a symbol from the key timing decoder.
+ * Used for audio input and for key timing traces. */
+static char keyed_char(morse_sym_t sym)
+{
+	char c = '\0';
+
+	if (sym != MORSE_SYM_INVALID)
+		c = morse_sym_to_ascii(sym);
+	/* Garbage is common in off-air audio and in hand keyed traces.
+	 * Mark it, but go on. */
+	return c ? c : '#';
+}
+
+static void keyed_emit(void *opaque, morse_sym_t sym)
+{
+	output_putc(keyed_char(sym));
+}
+
+static int audio_in_start(void)
+{
+	unsigned int block_len;
+
+	block_len = (unsigned int)((uint64_t)audio_in.wav.rate * DIT_LENGTH_1WPM_MS /
+				   1000 / audio_wpm / AUDIO_BLOCKS_PER_DIT);
+	if (skim) {
+		if (!block_len || skimmer_init(&audio_in.skimmer, audio_in.wav.rate,
+					       block_len, AUDIO_BLOCKS_PER_DIT,
+					       nr_jobs, keyed_char,
+					       output_write)) {
+			fprintf(stderr, "Unsupported WAV sample rate %u\n",
+				audio_in.wav.rate);
+			return -1;
+		}
+		return 0;
+	}
+	if (!block_len || audio_freq >= audio_in.wav.rate / 2) {
+		fprintf(stderr, "Unsupported WAV sample rate %u\n",
+			audio_in.wav.rate);
 		return -1;
 	}
-	putchar(achar);
+	tone_detector_init(&audio_in.detector, audio_in.wav.rate,
+			   audio_freq, block_len);
+	key_decoder_init(&audio_in.keys, AUDIO_BLOCKS_PER_DIT,
+			 keyed_emit, NULL);
+	key_decoder_track(&audio_in.keys, AUDIO_DIT_MIN, AUDIO_DIT_MAX);
 
 	return 0;
 }
 
-static int morse_decode_dashdot(void)
+static int audio_in_samples(const char *pcm, size_t nr_samples)
 {
-	const char *input = input_text;
-	char c;
-	unsigned int i = 0;
-	unsigned int marks = 0;
-	int err;
+	size_t count;
+	bool decided;
+
+	if (skim)
+		return skimmer_run(&audio_in.skimmer, pcm, nr_samples);
+	while (nr_samples) {
+		count = tone_detector_run(&audio_in.detector, pcm,
+					  nr_samples, &decided);
+		pcm += count * 2;
+		nr_samples -= count;
+		if (decided)
+			key_decoder_sample(&audio_in.keys, audio_in.detector.key);
+	}
 
-	while (1) {
-		c = *input;
-		if (!c) {
-			if (i) {
-				err = decode_marks(marks, i);
-				if (err)
-					return err;
-			}
-			break;
-		}
-		input++;
-		if (c == '.') {
-			marks &= ~(1 << i);
-			marks |= (MORSE_DIT << i);
-			i++;
-		} else if (c == '-' || c == '_') {
-			marks &= ~(1 << i);
-			marks |= (MORSE_DAH << i);
-			i++;
-		} else if (isspace(c)) { /* end of char */
-			if (i) {
-				err = decode_marks(marks, i);
-				if (err)
-					return err;
-				i = 0;
-				marks = 0;
-			}
-		} else /* end of word */
-			putchar(' ');
-		if (i > 9) {
-			fprintf(stderr, "Too many marks\n");
+	return 0;
+}
+
+static int morse_decode_audio(const char *input, size_t len)
+{
+	char sample[2];
+	size_t count;
+
+	if (audio_in.wav.state != WAV_DATA) {
+		if (wav_reader_parse(&audio_in.wav, input, len, &count)) {
+			fprintf(stderr, "Unsupported or malformed WAV input. "
+				"16 bit mono PCM is required.\n");
 			return -1;
 		}
+		input += count;
+		len -= count;
+		if (audio_in.wav.state != WAV_DATA)
+			return 0;
+		if (audio_in_start())
+			return -1;
+	}
+
+	if (audio_in.have_byte && len) {
+		/* Complete the sample split by the previous chunk. */
+		sample[0] = audio_in.byte;
+		sample[1] = input[0];
+		if (audio_in_samples(sample, 1))
+			goto oom;
+		audio_in.have_byte = false;
+		input++;
+		len--;
+	}
+	if (audio_in_samples(input, len / 2))
+		goto oom;
+	if (len & 1) {
+		audio_in.byte = input[len - 1];
+		audio_in.have_byte = true;
 	}
 
 	return 0;
+
+oom:
+	fprintf(stderr, "Out of memory\n");
+	return -1;
 }
 
-static const char * eat(const char *str, char c)
+static int morse_decode_audio_finish(void)
 {
-	while (*str == c)
-		str++;
-	return str;
+	int err;
+
+	if (audio_in.wav.state != WAV_DATA) {
+		fprintf(stderr, "Truncated WAV input\n");
+		return -1;
+	}
+	if (skim) {
+		err = skimmer_finish(&audio_in.skimmer);
+		skimmer_free(&audio_in.skimmer);
+		if (err)
+			fprintf(stderr, "Out of memory\n");
+		return err;
+	}
+	while (tone_detector_flush(&audio_in.detector))
+		key_decoder_sample(&audio_in.keys, audio_in.detector.key);
+	key_decoder_finish(&audio_in.keys);
+	output_putc('\n');
+
+	return 0;
 }
 
-static const char * eat_alpha(const char *str)
+/* Key timing trace input.
+ * The text format is a list of durations in milliseconds, separated by
+ * whitespace or commas. A '+' prefix marks a key down (mark) and a '-'
+ * prefix a key up (gap) duration. Unsigned durations alternate,
+ * starting with a mark. Durations of the same kind add up.
+ * The binary format is a sequence of LEB128 varints of
+ * (duration << 1) | key down.
+ */
+static struct {
+	struct key_decoder keys;
+	/* The kind of the last duration */
+	bool mark;
+	/* The length of the current mark or gap */
+	uint64_t run;
+	/* The text number being parsed */
+	uint32_t value;
+	bool have_value;
+	char sign;
+	/* The varint being parsed */
+	uint32_t varint;
+	unsigned int shift;
+} trace;
+
+static void trace_init(void)
 {
-	while (isalpha(*str))
-		str++;
-	return str;
+	unsigned int dit = DIT_LENGTH_1WPM_MS / audio_wpm;
+
+	key_decoder_init(&trace.keys, dit, keyed_emit, NULL);
+	/* Twice to a quarter of --wpm. Like the audio decoder. */
+	key_decoder_track(&trace.keys, dit / 2, dit * 4);
 }
 
-static const char * eat_space(const char *str)
+static void trace_run_end(void)
 {
-	while (isspace(*str))
-		str++;
-	return str;
+	unsigned int len = (unsigned int)min(trace.run, (uint64_t)UINT_MAX);
+
+	if (!trace.run)
+		return;
+	if (trace.mark)
+		key_decoder_mark(&trace.keys, len);
+	else
+		key_decoder_gap(&trace.keys, len);
+	trace.run = 0;
 }
 
-static int morse_decode_ditdah(void)
+static void trace_put(bool mark, uint32_t ms)
 {
-	const char *input = input_text;
-	unsigned int i = 0;
-	unsigned int marks = 0;
-	int err;
+	if (mark != trace.mark)
+		trace_run_end();
+	trace.mark = mark;
+	trace.run += ms;
+}
 
-	while (1) {
-		if (!(*input)) {
-			if (i) {
-				err = decode_marks(marks, i);
-				if (err)
-					return err;
-			}
-			break;
-		}
-		if (strncasecmp(input, "di", 2) == 0) {
-			marks &= ~(1 << i);
-			marks |= (MORSE_DIT << i);
-			i++;
-			input = eat_alpha(input);
-			input = eat(input, '-');
-		} else if (strncasecmp(input, "da", 2) == 0) {
-			marks &= ~(1 << i);
-			marks |= (MORSE_DAH << i);
-			i++;
-			input = eat_alpha(input);
-			input = eat(input, '-');
-		} else if (isspace(*input)) { /* end of char */
-			if (i) {
-				err = decode_marks(marks, i);
-				if (err)
-					return err;
-				i = 0;
-				marks = 0;
-			}
-			input = eat_space(input);
-		} else { /* end of word */
-			putchar(' ');
-			input++;
-			input = eat_space(input);
-		}
-		if (i > 9) {
-			fprintf(stderr, "Too many marks\n");
+static int trace_number_end(void)
+{
+	if (!trace.have_value) {
+		if (trace.sign) {
+			fprintf(stderr, "Missing duration after '%c'\n", trace.sign);
 			return -1;
 		}
+		return 0;
 	}
+	if (trace.sign)
+		trace_put(trace.sign == '+', trace.value);
+	else
+		trace_put(!trace.mark, trace.value);
+	trace.value = 0;
+	trace.have_value = false;
+	trace.sign = '\0';
 
 	return 0;
 }
 
-static int morse_decode_binary(void)
+static int morse_decode_trace(const char *input, size_t len)
 {
 	size_t i;
-	morse_sym_t sym;
-	enum morse_character mchar;
-	char achar;
+	char c;
 
-	if (input_text_len % 2) {
-		fprintf(stderr, "Invalid input length (odd length)\n");
-		return -1;
-	}
-	for (i = 0; i < input_text_len; i += 2) {
-		if (syms_bigendian) {
-			sym = (uint16_t)input_text[i] << 8;
-			sym |= (uint16_t)input_text[i + 1];
+	for (i = 0; i < len; i++) {
+		c = input[i];
+		if (c >= '0' && c <= '9') {
+			if (trace.value > (UINT32_MAX - 9) / 10) {
+				fprintf(stderr, "Duration too long\n");
+				return -1;
+			}
+			trace.value = trace.value * 10 + (uint32_t)(c - '0');
+			trace.have_value = true;
+		} else if (c == '+' || c == '-') {
+			if (trace.have_value || trace.sign) {
+				fprintf(stderr, "Unexpected '%c' in timing trace\n", c);
+				return -1;
+			}
+			trace.sign = c;
+		} else if (isspace((unsigned char)c) || c == ',') {
+			if (trace_number_end())
+				return -1;
 		} else {
-			sym = (uint16_t)input_text[i];
-			sym |= (uint16_t)input_text[i + 1] << 8;
-		}
-		mchar = morse_decode_symbol(sym);
-		if (mchar == (enum morse_character)-1) {
-			fprintf(stderr, "Could not decode symbol 0x%04X\n",
-				(uint16_t)sym);
+			fprintf(stderr, "Invalid character in timing trace: %c\n", c);
 			return -1;
 		}
-		achar = morse_to_ascii(mchar);
-		if (!achar) {
-			fprintf(stderr, "Could not decode morse char 0x%02X\n",
-				(uint8_t)mchar);
+	}
+
+	return 0;
+}
+
+static int morse_decode_trace_varint(const char *input, size_t len)
+{
+	uint8_t byte;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		byte = (uint8_t)input[i];
+		if (trace.shift > 28 || (trace.shift == 28 && (byte & 0x70))) {
+			fprintf(stderr, "Varint too long\n");
 			return -1;
 		}
-		putchar(achar);
+		trace.varint |= (uint32_t)(byte & 0x7F) << trace.shift;
+		trace.shift += 7;
+		if (byte & 0x80)
+			continue;
+		trace_put(trace.varint & 1, trace.varint >> 1);
+		trace.varint = 0;
+		trace.shift = 0;
 	}
 
 	return 0;
 }
 
-static int morse_decode(void)
+static int morse_decode_trace_finish(void)
 {
-	int err = -1;
+	if (morse_encoding == ENC_TRACE) {
+		if (trace_number_end())
+			return -1;
+	} else if (trace.shift) {
+		fprintf(stderr, "Truncated varint\n");
+		return -1;
+	}
+	trace_run_end();
+	key_decoder_flush(&trace.keys);
+	output_putc('\n');
 
-	switch (morse_encoding) {
-	case ENC_DASHDOT:
-		err = morse_decode_dashdot();
-		break;
-	case ENC_DITDAH:
-		err = morse_decode_ditdah();
-		break;
-	case ENC_BINARY:
-		err = morse_decode_binary();
-		break;
+	return 0;
+}
+
+/* Run the text formats through libmorse.
+ * The output is produced straight into the output buffer. */
+static int morse_run(const char *input, size_t len)
+{
+	size_t consumed, produced;
+	int err;
+
+	while (1) {
+		err = morse_process(&morse, input, len, &consumed,
+				    &output.buf[output.len],
+				    output.size - output.len, &produced);
+		output.len += produced;
+		if (err) {
+			fprintf(stderr, "%s\n", morse.error);
+			return err;
+		}
+		input += consumed;
+		len -= consumed;
+		if (!len)
+			return 0;
+		output_flush();
 	}
+}
+
+static int morse_run_finish(void)
+{
+	size_t produced;
+	int err;
+
+	if (output.size - output.len < MORSE_OUT_SLACK)
+		output_flush();
+	err = morse_finish(&morse, &output.buf[output.len],
+			   output.size - output.len, &produced);
+	output.len += produced;
 	if (err)
-		return err;
-	putchar('\n');
+		fprintf(stderr, "%s\n", morse.error);
 
-	return 0;
+	return err;
 }
 
-static void * checked_realloc(void *buf, size_t size)
+/* Process everything from a file descriptor.
+ * The input is read and processed block by block, so memory usage is
+ * independent of the input size. If stop_at_nul is true, the input
+ * ends at the first NUL character.
+ */
+static int process_stream(int fd,
+			  int (*process)(const char *input, size_t len),
+			  int (*finish)(void),
+			  bool stop_at_nul)
 {
-	buf = realloc(buf, size);
-	if (!buf) {
-		fprintf(stderr, "Out of memory\n");
-		exit(1);
+	char *buf;
+	const char *nul = NULL;
+	ssize_t res;
+	size_t len;
+	int err = 0;
+	bool empty = true;
+
+	buf = checked_realloc(NULL, STREAM_BLOCK_SIZE);
+	while (1) {
+		res = read(fd, buf, STREAM_BLOCK_SIZE);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Failed to read input: %s\n",
+				strerror(errno));
+			err = -1;
+			break;
+		}
+		if (res == 0) {
+			/* End of file */
+			if (empty)
+				err = -1;
+			else
+				err = finish();
+			break;
+		}
+		empty = false;
+
+		len = (size_t)res;
+		if (stop_at_nul) {
+			nul = memchr(buf, '\0', len);
+			if (nul)
+				len = (size_t)(nul - buf);
+		}
+		err = process(buf, len);
+		if (err)
+			break;
+		if (nul) {
+			err = finish();
+			break;
+		}
+		output_flush();
 	}
+	free(buf);
 
-	return buf;
+	return err;
+}
+
+/* Parallel processing of the input stream.
+ * The input is cut into chunks, which are processed by a pool of
+ * worker threads. The output of the chunks is written in input order.
+ *
+ * Encoding has no state across characters, so every chunk can be
+ * encoded independently. For decoding, a chunk is cut right after
+ * a resynchronization point, where the decoder most likely is back in
+ * its initial state (see morse_resync()). The workers decode from
+ * the initial state. If the real decoder state at the start of the
+ * chunk turns out to be different, or if the worker failed, the main
+ * thread processes the chunk once more in order. That reproduces the
+ * exact serial output and error messages.
+ *
+ * The main thread alone reads the input, scans it for NUL, cuts it at
+ * the resync points and writes all output. That is the serial part,
+ * which bounds the scaling. Encoding expands the text about four times,
+ * so the write bandwidth of the main thread is the limit. A reprocessed
+ * chunk is serial, too.
+ */
+
+enum chunk_state {
+	CHUNK_FREE,		/* Unused */
+	CHUNK_QUEUED,		/* Filled with input. Waiting for a worker */
+	CHUNK_DONE,		/* Processed. Waiting to be written */
+};
+
+struct chunk {
+	enum chunk_state state;
+	char *input;
+	size_t input_len;
+	/* The chunk starts at a resynchronization point. */
+	bool resynced;
+	/* The processing result */
+	int err;
+	struct output_buffer output;
+	/* The libmorse state at the end of the chunk */
+	struct morse_ctx morse;
+};
+
+struct worker_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* The initial libmorse state */
+	struct morse_ctx morse;
+	/* Ring of chunks, indexed by the sequence number */
+	struct chunk *chunks;
+	unsigned int nr_chunks;
+	/* Sequence number of the next chunk to queue */
+	unsigned long queued;
+	/* Sequence number of the next chunk to process */
+	unsigned long next;
+	bool stop;
+};
+
+static void * worker_thread(void *arg)
+{
+	struct worker_pool *pool = arg;
+	struct chunk *c;
+	size_t consumed;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->stop) {
+		if (pool->next == pool->queued) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		c = &pool->chunks[pool->next++ % pool->nr_chunks];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (c->resynced) {
+			/* The chunk output buffer is big enough for the
+			 * worst case, so all input is consumed at once.
+			 * Errors are reported by the main thread. */
+			c->morse = pool->morse;
+			c->err = morse_process(&c->morse, c->input, c->input_len,
+					       &consumed, c->output.buf,
+					       c->output.size, &c->output.len);
+			if (consumed != c->input_len)
+				c->err = -1;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		c->state = CHUNK_DONE;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/* Read until buf is full or the input ends.
+ * Returns the number of bytes read or -1 on error. */
+static ssize_t read_full(int fd, char *buf, size_t size, bool *eof)
+{
+	size_t len = 0;
+	ssize_t res;
+
+	while (len < size) {
+		res = read(fd, buf + len, size - len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (res == 0) {
+			*eof = true;
+			break;
+		}
+		len += (size_t)res;
+	}
+
+	return (ssize_t)len;
+}
+
+/* Process everything from a file descriptor with nr_jobs threads.
+ * The output is identical to process_stream(). */
+static int process_stream_parallel(int fd, bool stop_at_nul)
+{
+	struct worker_pool pool = {
+		.lock		= PTHREAD_MUTEX_INITIALIZER,
+		.cond		= PTHREAD_COND_INITIALIZER,
+		.morse		= morse,
+	};
+	pthread_t *threads;
+	struct chunk *c;
+	const char *nul;
+	char *carry;
+	size_t output_size, carry_len = 0, cut;
+	ssize_t res;
+	unsigned long written = 0;
+	unsigned int i, nr_threads = 0;
+	int err = 0, read_errno = 0;
+	bool eof = false, empty = true, resynced = true;
+
+	output_size = morse_out_bound(&morse, PARALLEL_CHUNK_SIZE);
+
+	/* Two chunks per worker keep the workers busy while
+	 * the input is read and the output is written. */
+	pool.nr_chunks = nr_jobs * 2;
+	pool.chunks = checked_realloc(NULL, pool.nr_chunks * sizeof(*pool.chunks));
+	for (i = 0; i < pool.nr_chunks; i++) {
+		c = &pool.chunks[i];
+		c->state = CHUNK_FREE;
+		c->input = checked_realloc(NULL, PARALLEL_CHUNK_SIZE);
+		c->output.buf = checked_realloc(NULL, output_size);
+		c->output.size = output_size;
+	}
+	carry = checked_realloc(NULL, PARALLEL_CHUNK_SIZE);
+
+	threads = checked_realloc(NULL, nr_jobs * sizeof(*threads));
+	for (nr_threads = 0; nr_threads < nr_jobs; nr_threads++) {
+		if (pthread_create(&threads[nr_threads], NULL, worker_thread, &pool)) {
+			fprintf(stderr, "Failed to create worker thread\n");
+			err = -1;
+			goto out;
+		}
+	}
+
+	while (1) {
+		/* Queue input into all free chunks */
+		while (!eof && pool.queued - written < pool.nr_chunks) {
+			c = &pool.chunks[pool.queued % pool.nr_chunks];
+			memcpy(c->input, carry, carry_len);
+			res = read_full(fd, c->input + carry_len,
+					PARALLEL_CHUNK_SIZE - carry_len, &eof);
+			if (res < 0) {
+				/* Reported after the output of all
+				 * previous chunks. */
+				read_errno = errno;
+				eof = true;
+				res = 0;
+			}
+			if (res)
+				empty = false;
+			c->input_len = carry_len + (size_t)res;
+			carry_len = 0;
+			if (stop_at_nul) {
+				nul = memchr(c->input, '\0', c->input_len);
+				if (nul) {
+					c->input_len = (size_t)(nul - c->input);
+					eof = true;
+				}
+			}
+			if (!c->input_len)
+				continue;
+
+			c->resynced = resynced;
+			if (decode && !eof) {
+				/* Cut the chunk at the last resync point and
+				 * carry the rest over to the next chunk. */
+				cut = morse_resync(&morse, c->input, c->input_len);
+				resynced = (cut != 0);
+				if (cut) {
+					carry_len = c->input_len - cut;
+					memcpy(carry, c->input + cut, carry_len);
+					c->input_len = cut;
+				}
+			}
+
+			pthread_mutex_lock(&pool.lock);
+			c->state = CHUNK_QUEUED;
+			pool.queued++;
+			pthread_cond_broadcast(&pool.cond);
+			pthread_mutex_unlock(&pool.lock);
+		}
+		if (written == pool.queued)
+			break;
+
+		/* Write out the oldest chunk */
+		c = &pool.chunks[written % pool.nr_chunks];
+		pthread_mutex_lock(&pool.lock);
+		while (c->state != CHUNK_DONE)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		c->state = CHUNK_FREE;
+		pthread_mutex_unlock(&pool.lock);
+		written++;
+
+		if (c->resynced && !c->err && morse_is_initial(&morse)) {
+			write_stdout(c->output.buf, c->output.len);
+			morse = c->morse;
+			continue;
+		}
+		/* Process the chunk again with the real state. */
+		err = morse_run(c->input, c->input_len);
+		output_flush();
+		if (err)
+			goto out;
+	}
+
+	if (read_errno) {
+		fprintf(stderr, "Failed to read input: %s\n",
+			strerror(read_errno));
+		err = -1;
+	} else if (empty) {
+		err = -1;
+	} else {
+		err = morse_run_finish();
+	}
+out:
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = true;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	for (i = 0; i < pool.nr_chunks; i++) {
+		free(pool.chunks[i].input);
+		free(pool.chunks[i].output.buf);
+	}
+	free(pool.chunks);
+	free(carry);
+
+	return err;
 }
 
 static void usage(int argc, char **argv)
@@ -639,7 +915,38 @@ static void usage(int argc, char **argv)
 	printf(" -B|--binary          Binary format\n");
 	printf(" -d|--dashdot         Human readable dash/dot format (default)\n");
 	printf(" -D|--ditdah          Human readable dit/dah format\n");
+	printf(" -P|--packed          Packed variable length bitstream format\n");
+	printf(" -t|--trace           Key timing trace. Durations in ms (decode only)\n");
+	printf(" -v|--trace-varint    Key timing trace. Varints (decode only)\n");
+	printf(" -p|--pcm             Audio output. Signed 16 bit LE mono PCM\n");
+	printf(" -w|--wav             Audio output. WAV file\n");
+	printf(" -S|--wpm WPM         Audio or trace speed in words per minute (default 20)\n");
+	printf(" -F|--freq HZ         Audio tone frequency (default 700)\n");
+	printf(" -R|--rate HZ         Audio sample rate (default 8000)\n");
+	printf(" -j|--jobs N          Process with N threads (default 1)\n");
+	printf(" -L|--listen PATH     Serve requests on a Unix socket (see server.h)\n");
+	printf(" -f|--files           Convert the files and directories given as STRING\n");
+	printf("                      FILE is encoded to FILE" BATCH_SUFFIX "\n");
+	printf("                      FILE" BATCH_SUFFIX " is decoded to FILE" BATCH_SUFFIX BATCH_DECODED_SUFFIX "\n");
 	printf(" -x|--decode          Switch to decode mode\n");
+	printf(" -W|--from-wav        Decode 16 bit mono WAV audio\n");
+	printf(" -K|--skim            Decode all signals in wideband WAV audio\n");
+}
+
+static int parse_uint(const char *str, unsigned int min, unsigned int max,
+		      const char *name, unsigned int *value)
+{
+	unsigned long v;
+	char *end;
+
+	v = strtoul(str, &end, 10);
+	if (!*str || *end || v < min || v > max) {
+		fprintf(stderr, "Invalid %s: %s\n", name, str);
+		return -1;
+	}
+	*value = (unsigned int)v;
+
+	return 0;
 }
 
 static int parse_args(int argc, char **argv)
@@ -654,11 +961,25 @@ static int parse_args(int argc, char **argv)
 		{ .name = "binary",	.has_arg = no_argument, .flag = NULL, .val = 'B' },
 		{ .name = "ditdah",	.has_arg = no_argument, .flag = NULL, .val = 'D' },
 		{ .name = "dashdot",	.has_arg = no_argument, .flag = NULL, .val = 'd' },
+		{ .name = "packed",	.has_arg = no_argument, .flag = NULL, .val = 'P' },
+		{ .name = "trace",	.has_arg = no_argument, .flag = NULL, .val = 't' },
+		{ .name = "trace-varint", .has_arg = no_argument, .flag = NULL, .val = 'v' },
+		{ .name = "pcm",	.has_arg = no_argument, .flag = NULL, .val = 'p' },
+		{ .name = "wav",	.has_arg = no_argument, .flag = NULL, .val = 'w' },
+		{ .name = "wpm",	.has_arg = required_argument, .flag = NULL, .val = 'S' },
+		{ .name = "freq",	.has_arg = required_argument, .flag = NULL, .val = 'F' },
+		{ .name = "rate",	.has_arg = required_argument, .flag = NULL, .val = 'R' },
 		{ .name = "decode",	.has_arg = no_argument, .flag = NULL, .val = 'x' },
+		{ .name = "from-wav",	.has_arg = no_argument, .flag = NULL, .val = 'W' },
+		{ .name = "skim",	.has_arg = no_argument, .flag = NULL, .val = 'K' },
+		{ .name = "jobs",	.has_arg = required_argument, .flag = NULL, .val = 'j' },
+		{ .name = "listen",	.has_arg = required_argument, .flag = NULL, .val = 'L' },
+		{ .name = "files",	.has_arg = no_argument, .flag = NULL, .val = 'f' },
+		{ .name = NULL, },
 	};
 
 	while (1) {
-		c = getopt_long(argc, argv, "hbBDdx", long_opts, &i);
+		c = getopt_long(argc, argv, "hbBDdPtvpwS:F:R:xWKj:L:f", long_opts, &i);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -677,13 +998,91 @@ static int parse_args(int argc, char **argv)
 		case 'D':
 			morse_encoding = ENC_DITDAH;
 			break;
+		case 'P':
+			morse_encoding = ENC_PACKED;
+			break;
+		case 't':
+			morse_encoding = ENC_TRACE;
+			break;
+		case 'v':
+			morse_encoding = ENC_TRACE_VARINT;
+			break;
 		case 'x':
 			decode = 1;
 			break;
+		case 'W':
+			decode = 1;
+			audio_input = true;
+			break;
+		case 'K':
+			decode = 1;
+			audio_input = true;
+			skim = true;
+			break;
+		case 'p':
+			audio_format = AUDIO_PCM;
+			break;
+		case 'w':
+			audio_format = AUDIO_WAV;
+			break;
+		case 'S':
+			if (parse_uint(optarg, 1, 200, "speed", &audio_wpm))
+				return -1;
+			break;
+		case 'F':
+			if (parse_uint(optarg, 1, 100000, "frequency", &audio_freq))
+				return -1;
+			break;
+		case 'R':
+			if (parse_uint(optarg, 1000, 384000, "sample rate", &audio_rate))
+				return -1;
+			break;
+		case 'j':
+			if (parse_uint(optarg, 1, MAX_NR_JOBS, "number of jobs", &nr_jobs))
+				return -1;
+			break;
+		case 'L':
+			listen_path = optarg;
+			break;
+		case 'f':
+			batch = true;
+			break;
 		default:
 			return -1;
 		}
 	}
+	if ((morse_encoding == ENC_TRACE ||
+	     morse_encoding == ENC_TRACE_VARINT) && !decode) {
+		fprintf(stderr, "Key timing traces are an input format only\n");
+		return -1;
+	}
+	if (audio_format != AUDIO_NONE) {
+		if (decode) {
+			fprintf(stderr, "Audio is an output format only\n");
+			return -1;
+		}
+		if (audio_freq >= audio_rate / 2) {
+			fprintf(stderr, "The tone frequency must be below "
+				"half the sample rate\n");
+			return -1;
+		}
+	}
+	if (batch) {
+		if (morse_encoding == ENC_TRACE ||
+		    morse_encoding == ENC_TRACE_VARINT ||
+		    audio_format != AUDIO_NONE || audio_input) {
+			fprintf(stderr, "Batch mode does not support "
+				"traces and audio\n");
+			return -1;
+		}
+		if (optind >= argc) {
+			fprintf(stderr, "No files given\n");
+			return -1;
+		}
+		batch_paths = &argv[optind];
+		nr_batch_paths = (unsigned int)(argc - optind);
+		return 0;
+	}
 	for (i = optind; i < argc; i++) {
 		len = strlen(argv[i]) + 1;
 		bufsize += len;
@@ -691,58 +1090,113 @@ static int parse_args(int argc, char **argv)
 		strcpy(&buf[bufsize - len], argv[i]);
 		buf[bufsize - 1] = ' ';
 	}
-	buf[bufsize - 1] = '\0';
-	input_text = buf;
+	if (buf) {
+		buf[bufsize - 1] = '\0';
+		input_text = buf;
+	}
 
 	return 0;
 }
 
-size_t stdin_read(char **buffer)
+static enum morse_format morse_format(void)
 {
-	char *buf = NULL;
-	size_t bufsize = 0, i = 0;
-	int c;
-
-	while (1) {
-		c = fgetc(stdin);
-		if (c == EOF)
-			break;
-		if (i + 1 >= bufsize) {
-			bufsize += 32;
-			buf = checked_realloc(buf, bufsize);
-		}
-		buf[i++] = c;
+	switch (morse_encoding) {
+	case ENC_BINARY:
+		return MORSE_FMT_BINARY;
+	case ENC_DITDAH:
+		return MORSE_FMT_DITDAH;
+	case ENC_PACKED:
+		return MORSE_FMT_PACKED;
+	case ENC_DASHDOT:
+	case ENC_TRACE:
+	case ENC_TRACE_VARINT:
+		break;
 	}
-	if (buf)
-		buf[i] = '\0';
-	*buffer = buf;
 
-	return i;
+	return MORSE_FMT_DASHDOT;
+}
+
+static unsigned int morse_flags(void)
+{
+	return (decode ? MORSE_DECODE : 0) |
+	       (syms_bigendian ? MORSE_BIGENDIAN : 0);
 }
 
 int main(int argc, char **argv)
 {
+	int (*process)(const char *input, size_t len);
+	int (*finish)(void);
+	bool binary_input;
 	int err;
 
+	output.buf = stdout_buf;
+	output.size = sizeof(stdout_buf);
+
 	err = parse_args(argc, argv);
 	if (err > 0)
 		return 0;
 	if (err < 0)
 		return 1;
 
-	if (input_text)
-		input_text_len = strlen(input_text);
-	else
-		input_text_len = stdin_read(&input_text);
-	if (!input_text || !input_text_len)
-		return 1;
+	/* The format of each request is chosen by the client. */
+	if (listen_path)
+		return server_run(listen_path, nr_jobs) ? 1 : 0;
+	if (batch) {
+		return batch_run(batch_paths, nr_batch_paths, morse_format(),
+				 morse_flags(), nr_jobs) ? 1 : 0;
+	}
 
-	if (decode)
-		err = morse_decode();
-	else
-		err = morse_encode();
+	if (audio_input) {
+		wav_reader_init(&audio_in.wav);
+		process = morse_decode_audio;
+		finish = morse_decode_audio_finish;
+	} else if (morse_encoding == ENC_TRACE) {
+		trace_init();
+		process = morse_decode_trace;
+		finish = morse_decode_trace_finish;
+	} else if (morse_encoding == ENC_TRACE_VARINT) {
+		trace_init();
+		process = morse_decode_trace_varint;
+		finish = morse_decode_trace_finish;
+	} else if (audio_format != AUDIO_NONE) {
+		if (audio_init())
+			return 1;
+		process = morse_encode_audio;
+		finish = morse_encode_audio_finish;
+	} else {
+		morse_init(&morse, morse_format(), morse_flags());
+		process = morse_run;
+		finish = morse_run_finish;
+	}
+	binary_input = audio_input ||
+		       (decode && (morse_encoding == ENC_BINARY ||
+				   morse_encoding == ENC_PACKED ||
+				   morse_encoding == ENC_TRACE_VARINT));
 
-	free(input_text);
+	if (input_text) {
+		input_text_len = strlen(input_text);
+		if (!input_text_len)
+			return 1;
+		err = process(input_text, input_text_len);
+		if (!err)
+			err = finish();
+		free(input_text);
+	} else if (nr_jobs > 1 && morse_encoding != ENC_PACKED &&
+		   morse_encoding != ENC_TRACE &&
+		   morse_encoding != ENC_TRACE_VARINT &&
+		   audio_format == AUDIO_NONE && !audio_input) {
+		/* The packed format is a single bitstream.
+		 * Traces carry the speed tracking state along.
+		 * Audio output is bound by the write bandwidth.
+		 * Audio input is a single signal. The skimmer
+		 * processes its channels in parallel by itself.
+		 * These are always processed serially. */
+		err = process_stream_parallel(STDIN_FILENO, !binary_input);
+	} else {
+		err = process_stream(STDIN_FILENO, process, finish,
+				     !binary_input);
+	}
+	output_flush();
 
 	return err ? 1 : 0;
 }
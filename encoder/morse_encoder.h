@@ -16,6 +16,8 @@ enum morse_marks {
  */
 typedef uint16_t morse_sym_t;
 
+#define MORSE_MAX_NR_MARKS		9
+
 /* Construct a morse symbol */
 #define __MORSE_SYM(marks, size)	((morse_sym_t)((marks) | (size) << 12))
 #define MORSE_SYM_1(m0)			__MORSE_SYM(((m0) << 0), 1)
@@ -0,0 +1,129 @@
+#ifndef MORSE_SPEED_H_
+#define MORSE_SPEED_H_
+
+#include <stdint.h>
+
+#include "morse_timing.h"
+
+/* Adaptive "dit" length estimator.
+ * This is shared by the host decoders and the myavr_morsedec firmware,
+ * so it only uses 16 bit integer math. morse_speed_threshold_long()
+ * is the host only exception.
+ * Every mark and every gap between marks updates an exponential average
+ * of the "dit" length. Dahs count with a third of their length.
+ * Marks up to the midpoint between "dit" and "dah" are dits.
+ * It follows any slowdown, but a speedup of more than about 1.5 times
+ * within a few characters is mistaken for dits only.
+ * The lengths are in arbitrary units (timer ticks, samples, ...)
+ * and must not exceed MORSE_SPEED_MAX_LEN.
+ */
+struct morse_speed {
+	/* The "dit" length, with MORSE_SPEED_SHIFT fractional bits */
+	uint16_t dit;
+	/* The limits of the "dit" length, same format */
+	uint16_t dit_min;
+	uint16_t dit_max;
+};
+
+/* Fractional bits of the "dit" length */
+#define MORSE_SPEED_SHIFT	4
+/* Weight of a new length in the average: 1 / (1 << MORSE_SPEED_GAIN) */
+#define MORSE_SPEED_GAIN	3
+/* Longest length that can be processed.
+ * Keeps all intermediate values within 16 bits. */
+#define MORSE_SPEED_MAX_LEN	(0x7FFF >> MORSE_SPEED_SHIFT)
+
+static inline void morse_speed_init(struct morse_speed *s, uint16_t dit_len,
+				    uint16_t dit_min, uint16_t dit_max)
+{
+	s->dit = dit_len << MORSE_SPEED_SHIFT;
+	s->dit_min = dit_min << MORSE_SPEED_SHIFT;
+	s->dit_max = dit_max << MORSE_SPEED_SHIFT;
+}
+
+/* Move the average towards one "dit" length sample. */
+static inline void morse_speed_update(struct morse_speed *s, uint16_t sample)
+{
+	uint16_t diff;
+
+	diff = sample > s->dit ? sample - s->dit : s->dit - sample;
+	/* Limit the influence of a single bad sample to 50% */
+	if (diff > s->dit / 2)
+		diff = s->dit / 2;
+	if (sample > s->dit)
+		s->dit += diff >> MORSE_SPEED_GAIN;
+	else
+		s->dit -= diff >> MORSE_SPEED_GAIN;
+
+	if (s->dit < s->dit_min)
+		s->dit = s->dit_min;
+	if (s->dit > s->dit_max)
+		s->dit = s->dit_max;
+}
+
+static inline uint16_t __morse_speed_threshold(const struct morse_speed *s,
+					       uint8_t factor)
+{
+	uint16_t t = s->dit * factor;
+
+	return (uint16_t)((t + (1 << (MORSE_SPEED_SHIFT - 1))) >> MORSE_SPEED_SHIFT);
+}
+
+/* The midpoint between lengths of factor_a and factor_b "dits".
+ * Rounded to the nearest unit.
+ * The "dit" length is at most MORSE_SPEED_MAX_LEN, so this fits into
+ * 16 bits, if the factors add up to 2 or 4. Other factors fail to build.
+ * Use morse_speed_threshold_long() for them. */
+#define morse_speed_threshold(s, factor_a, factor_b)				\
+	__morse_speed_threshold((s), (uint8_t)(((factor_a) + (factor_b)) / 2 +	\
+		0 * sizeof(char[((factor_a) + (factor_b) == 2 ||		\
+				 (factor_a) + (factor_b) == 4) ? 1 : -1])))
+
+/* The same for any factors. 32 bit math. Not for the firmware. */
+static inline uint16_t morse_speed_threshold_long(const struct morse_speed *s,
+						  uint8_t factor_a, uint8_t factor_b)
+{
+	uint32_t t = (uint32_t)s->dit * (factor_a + factor_b) / 2;
+
+	return (uint16_t)((t + (1 << (MORSE_SPEED_SHIFT - 1))) >> MORSE_SPEED_SHIFT);
+}
+
+/* The "dit" length, rounded to the nearest unit. At least 1. */
+static inline uint16_t morse_speed_dit(const struct morse_speed *s)
+{
+	uint16_t dit = morse_speed_threshold(s, FACTOR_DIT, FACTOR_DIT);
+
+	return dit ? dit : 1;
+}
+
+/* Classify a mark and learn from it.
+ * Returns 1 for a "dah" and 0 for a "dit". */
+static inline uint8_t morse_speed_mark(struct morse_speed *s, uint16_t len)
+{
+	uint16_t sample;
+	uint8_t dah;
+
+	if (len > MORSE_SPEED_MAX_LEN)
+		len = MORSE_SPEED_MAX_LEN;
+	sample = len << MORSE_SPEED_SHIFT;
+	dah = len >= morse_speed_threshold(s, FACTOR_DIT, FACTOR_DAH);
+	if (dah)
+		sample /= FACTOR_DAH;
+	morse_speed_update(s, sample);
+
+	return dah;
+}
+
+/* Learn from a gap. Only gaps between the marks of a character
+ * are used. The spacing between characters and words varies a lot
+ * between operators. */
+static inline void morse_speed_gap(struct morse_speed *s, uint16_t len)
+{
+	if (len > MORSE_SPEED_MAX_LEN)
+		return;
+	if (len >= morse_speed_threshold(s, FACTOR_INTER_MARK, FACTOR_INTER_CHAR))
+		return;
+	morse_speed_update(s, len << MORSE_SPEED_SHIFT);
+}
+
+#endif /* MORSE_SPEED_H_ */
@@ -0,0 +1,17 @@
+#ifndef MORSE_TIMING_H_
+#define MORSE_TIMING_H_
+
+/* Morse factors - In multiples of "dit" */
+enum morse_factors {
+	FACTOR_DIT		= 1,
+	FACTOR_DAH		= 3,
+	FACTOR_INTER_MARK	= 1,
+	FACTOR_INTER_CHAR	= 3,
+	FACTOR_INTER_WORD	= 7,
+};
+
+/* Length of one "dit" in milliseconds at a rate
+ * of one word per minute. */
+#define DIT_LENGTH_1WPM_MS	1200
+
+#endif /* MORSE_TIMING_H_ */
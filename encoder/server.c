@@ -0,0 +1,417 @@
+/*
+ *  Morse encoder server
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE	/* accept4() */
+
+#include "server.h"
+#include "libmorse.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+
+/* Size of the blocks read from a connection */
+#define SERVER_READ_SIZE	(64 * 1024)
+/* Events handled per epoll_wait() */
+#define SERVER_NR_EVENTS	64
+/* Wait time after a failed accept(), if no connection can be dropped */
+#define SERVER_BACKOFF_US	(100 * 1000)
+
+/* A client connection.
+ * Connections are owned by the thread that accepted them. */
+struct connection {
+	int fd;
+	/* Received request bytes */
+	char *in;
+	size_t in_len;
+	size_t in_size;
+	/* Reply bytes. Sent from out_pos to out_len. */
+	char *out;
+	size_t out_len;
+	size_t out_pos;
+	size_t out_size;
+	/* Waiting for the socket to become writable */
+	bool writing;
+	/* The client closed its side, or the stream is unusable.
+	 * The connection is closed after the pending replies. */
+	bool eof;
+};
+
+struct server {
+	int listen_fd;
+};
+
+
+static int reserve(char **buf, size_t *size, size_t len)
+{
+	char *b;
+
+	if (len <= *size)
+		return 0;
+	len = max(len, *size * 2);
+	b = realloc(*buf, len);
+	if (!b)
+		return -1;
+	*buf = b;
+	*size = len;
+
+	return 0;
+}
+
+static void conn_close(int ep, struct connection *c)
+{
+	epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+/* Append an error reply */
+static int reply_error(struct connection *c, const char *msg)
+{
+	size_t len = strlen(msg);
+
+	if (reserve(&c->out, &c->out_size, c->out_len + SERVER_HDR_SIZE + len))
+		return -1;
+	server_header(&c->out[c->out_len], (uint32_t)len, SERVER_ERROR, 0);
+	memcpy(&c->out[c->out_len + SERVER_HDR_SIZE], msg, len);
+	c->out_len += SERVER_HDR_SIZE + len;
+
+	return 0;
+}
+
+/* Process one request and append the reply.
+ * The whole reply fits into one span, so libmorse runs only once. */
+static int handle_request(struct connection *c, const char *hdr,
+			  const char *payload, size_t len)
+{
+	struct morse_ctx ctx;
+	size_t consumed, produced, pos;
+	char *out;
+	int err;
+
+	/* morse_encoder fails on empty input, too. */
+	if (!len)
+		return reply_error(c, "Empty input");
+	morse_init(&ctx, (enum morse_format)(uint8_t)hdr[4], (uint8_t)hdr[5]);
+	if (reserve(&c->out, &c->out_size, c->out_len + SERVER_HDR_SIZE +
+		    morse_out_bound(&ctx, len) + MORSE_OUT_SLACK))
+		return -1;
+	out = &c->out[c->out_len + SERVER_HDR_SIZE];
+	pos = 0;
+
+	err = morse_process(&ctx, payload, len, &consumed,
+			    out, c->out_size - (size_t)(out - c->out), &produced);
+	pos += produced;
+	if (!err && consumed == len) {
+		err = morse_finish(&ctx, out + pos,
+				   c->out_size - (size_t)(out + pos - c->out),
+				   &produced);
+		pos += produced;
+	}
+	if (err || consumed != len)
+		return reply_error(c, ctx.error);
+
+	server_header(&c->out[c->out_len], (uint32_t)pos, SERVER_OK, 0);
+	c->out_len += SERVER_HDR_SIZE + pos;
+
+	return 0;
+}
+
+/* Process all complete requests in the input buffer */
+static int conn_process(struct connection *c)
+{
+	const char *hdr;
+	size_t pos = 0, len;
+	uint8_t format, flags;
+
+	while (c->in_len - pos >= SERVER_HDR_SIZE && !c->eof) {
+		hdr = &c->in[pos];
+		len = get_le32(hdr);
+		format = (uint8_t)hdr[4];
+		flags = (uint8_t)hdr[5];
+		if (len > SERVER_MAX_LEN || format > MORSE_FMT_PACKED ||
+		    (flags & ~(MORSE_DECODE | MORSE_BIGENDIAN)) ||
+		    hdr[6] || hdr[7]) {
+			/* The stream can not be resynchronized. */
+			c->eof = true;
+			return reply_error(c, "Invalid request");
+		}
+		if (c->in_len - pos < SERVER_HDR_SIZE + len) {
+			/* Make room for the rest of the request */
+			if (reserve(&c->in, &c->in_size, SERVER_HDR_SIZE + len))
+				return -1;
+			break;
+		}
+		if (handle_request(c, hdr, hdr + SERVER_HDR_SIZE, len))
+			return -1;
+		pos += SERVER_HDR_SIZE + len;
+	}
+	memmove(c->in, &c->in[pos], c->in_len - pos);
+	c->in_len -= pos;
+
+	return 0;
+}
+
+static int conn_update(int ep, struct connection *c, bool writing)
+{
+	struct epoll_event ev = {
+		.events = writing ? EPOLLOUT : EPOLLIN,
+		.data.ptr = c,
+	};
+
+	if (writing == c->writing)
+		return 0;
+	c->writing = writing;
+
+	return epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Send pending replies.
+ * While a reply is pending, no more requests are read. */
+static int conn_write(int ep, struct connection *c)
+{
+	ssize_t res;
+
+	while (c->out_pos < c->out_len) {
+		res = send(c->fd, &c->out[c->out_pos], c->out_len - c->out_pos,
+			   MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return conn_update(ep, c, true);
+			return -1;
+		}
+		c->out_pos += (size_t)res;
+	}
+	c->out_pos = 0;
+	c->out_len = 0;
+	if (c->eof)
+		return -1;
+
+	return conn_update(ep, c, false);
+}
+
+static int conn_read(int ep, struct connection *c)
+{
+	ssize_t res;
+
+	if (reserve(&c->in, &c->in_size, c->in_len + SERVER_READ_SIZE))
+		return -1;
+	res = recv(c->fd, &c->in[c->in_len], c->in_size - c->in_len, 0);
+	if (res < 0) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		return -1;
+	}
+	if (res == 0)
+		c->eof = true;
+	c->in_len += (size_t)res;
+
+	if (conn_process(c))
+		return -1;
+
+	return conn_write(ep, c);
+}
+
+/* Out of file descriptors. The pending connection keeps the listen fd
+ * readable, so it must be taken off the queue. The reserve fd is
+ * closed to make room, and the connection is accepted and closed.
+ * Returns false, if the connection could not be dropped either. */
+static bool server_drop(int listen_fd, int *reserve_fd)
+{
+	int fd;
+
+	if (*reserve_fd < 0)
+		return false;
+	close(*reserve_fd);
+	fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd >= 0)
+		close(fd);
+	*reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	return fd >= 0;
+}
+
+static void server_accept(int ep, int listen_fd, int *reserve_fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, };
+	struct connection *c;
+	int fd;
+
+	while (1) {
+		fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			if (errno == EMFILE || errno == ENFILE) {
+				if (server_drop(listen_fd, reserve_fd)) {
+					fprintf(stderr, "Out of file descriptors. "
+						"Connection dropped.\n");
+					continue;
+				}
+				/* Back off. See server_thread(). */
+				fprintf(stderr, "Out of file descriptors\n");
+				usleep(SERVER_BACKOFF_US);
+				return;
+			}
+			fprintf(stderr, "Failed to accept: %s\n", strerror(errno));
+			return;
+		}
+		c = calloc(1, sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		ev.data.ptr = c;
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev)) {
+			close(fd);
+			free(c);
+		}
+	}
+}
+
+/* The event loop of one thread.
+ * All threads wait for new connections. EPOLLEXCLUSIVE wakes
+ * only one of them. Every thread keeps a reserve fd for
+ * server_drop(). */
+static void * server_thread(void *arg)
+{
+	struct server *s = arg;
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL, };
+	struct epoll_event events[SERVER_NR_EVENTS];
+	struct connection *c;
+	int ep, i, n, err, reserve_fd;
+
+	reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, s->listen_fd, &ev)) {
+		fprintf(stderr, "Failed to set up epoll: %s\n", strerror(errno));
+		exit(1);
+	}
+	while (1) {
+		n = epoll_wait(ep, events, SERVER_NR_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+			exit(1);
+		}
+		for (i = 0; i < n; i++) {
+			c = events[i].data.ptr;
+			if (!c) {
+				server_accept(ep, s->listen_fd, &reserve_fd);
+				continue;
+			}
+			if (events[i].events & EPOLLOUT)
+				err = conn_write(ep, c);
+			else
+				err = conn_read(ep, c);
+			if (err)
+				conn_close(ep, c);
+		}
+	}
+
+	return NULL;
+}
+
+/* Check whether a socket file is left over from a dead server */
+static bool socket_is_stale(const struct sockaddr_un *addr)
+{
+	int fd, err;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+	err = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	close(fd);
+
+	return err && errno == ECONNREFUSED;
+}
+
+static int server_listen(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX, };
+	int fd, err;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		goto error;
+	err = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (err && errno == EADDRINUSE && socket_is_stale(&addr)) {
+		unlink(path);
+		err = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	}
+	if (err || listen(fd, SOMAXCONN))
+		goto error;
+
+	return fd;
+
+error:
+	fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
+
+/* Serve requests on a Unix domain socket with nr_threads threads.
+ * This only returns on errors. */
+int server_run(const char *path, unsigned int nr_threads)
+{
+	static struct server s;
+	pthread_t thread;
+	unsigned int i;
+
+	s.listen_fd = server_listen(path);
+	if (s.listen_fd < 0)
+		return -1;
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&thread, NULL, server_thread, &s)) {
+			fprintf(stderr, "Failed to create server thread\n");
+			return -1;
+		}
+		pthread_detach(thread);
+	}
+	server_thread(&s);
+
+	return 0;
+}
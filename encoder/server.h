@@ -0,0 +1,65 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "util.h"
+
+#include <stddef.h>
+
+
+/* The request protocol of the morse_encoder server.
+ *
+ * Requests and replies are a header followed by a payload.
+ * Request header:
+ *   le32  Payload length
+ *   u8    enum morse_format
+ *   u8    libmorse flags (MORSE_DECODE, MORSE_BIGENDIAN)
+ *   le16  Reserved, 0
+ * Reply header:
+ *   le32  Payload length
+ *   u8    enum server_status
+ *   u8    Reserved, 0
+ *   le16  Reserved, 0
+ *
+ * The request payload is the complete input. The reply payload is the
+ * complete output, as a morse_encoder run with that input would write
+ * it, or an error message. Requests on one connection may be pipelined.
+ * They are answered in order.
+ */
+#define SERVER_HDR_SIZE		8
+/* Longest request payload */
+#define SERVER_MAX_LEN		(1024 * 1024)
+
+enum server_status {
+	SERVER_OK,
+	SERVER_ERROR,
+};
+
+static inline uint32_t get_le32(const char *buf)
+{
+	const uint8_t *b = (const uint8_t *)buf;
+
+	return (uint32_t)b[0] | (uint32_t)b[1] << 8 |
+	       (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static inline void put_le32(char *buf, uint32_t v)
+{
+	buf[0] = (char)v;
+	buf[1] = (char)(v >> 8);
+	buf[2] = (char)(v >> 16);
+	buf[3] = (char)(v >> 24);
+}
+
+static inline void server_header(char *hdr, uint32_t len,
+				 uint8_t a, uint8_t b)
+{
+	put_le32(hdr, len);
+	hdr[4] = (char)a;
+	hdr[5] = (char)b;
+	hdr[6] = 0;
+	hdr[7] = 0;
+}
+
+int server_run(const char *path, unsigned int nr_threads);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,559 @@
+/*
+ *  Morse wideband multi signal decoder
+ *
+ *  Copyright (C) 2026 agent <agent@local>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "skimmer.h"
+#include "audio.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+# include <xmmintrin.h>
+#endif
+
+
+#define PI			3.14159265358979323846
+
+/* Lowest decoded frequency. Also the distance of the highest
+ * decoded frequency to the Nyquist frequency. */
+#define SKIM_MIN_FREQ		200
+/* The signal level window around a frame. Like the tone detector. */
+#define SKIM_WINDOW		TONE_WINDOW
+/* Number of frames decided at once */
+#define SKIM_BATCH		256
+/* Frames kept before the first undecided one */
+#define SKIM_HISTORY		(SKIM_WINDOW / 2)
+#define SKIM_ROWS		(SKIM_WINDOW + SKIM_BATCH)
+/* Required ratio of the signal level and the noise floor */
+#define SKIM_MIN_SNR		300.0f
+/* Hysteresis around the decision threshold, as power ratio */
+#define SKIM_HYSTERESIS		2.0f
+/* A gap of this many "dits" ends a line of text */
+#define SKIM_LINE_GAP		14
+/* Lines shorter than this are mostly noise */
+#define SKIM_MIN_LINE		2
+
+static void skim_putc(struct skim_channel *ch, char c)
+{
+	size_t size;
+	char *text;
+
+	if (ch->len == ch->size) {
+		size = ch->size ? ch->size * 2 : 64;
+		text = realloc(ch->text, size);
+		if (!text) {
+			ch->oom = true;
+			return;
+		}
+		ch->text = text;
+		ch->size = size;
+	}
+	ch->text[ch->len++] = c;
+}
+
+static void skim_emit(void *opaque, morse_sym_t sym)
+{
+	struct skim_channel *ch = opaque;
+	char c;
+
+	c = ch->s->decode(sym);
+	if (c == ' ' && ch->len == ch->line)
+		return;
+	skim_putc(ch, c);
+}
+
+static void skim_end_line(struct skim_channel *ch)
+{
+	while (ch->len > ch->line && ch->text[ch->len - 1] == ' ')
+		ch->len--;
+	if (ch->len - ch->line < SKIM_MIN_LINE) {
+		ch->len = ch->line;
+		return;
+	}
+	skim_putc(ch, '\n');
+	ch->line = ch->len;
+}
+
+static void * skim_thread(void *arg);
+
+int skimmer_init(struct skimmer *s, unsigned int rate,
+		 unsigned int block_len, unsigned int blocks_per_dit,
+		 unsigned int nr_threads,
+		 char (*decode)(morse_sym_t sym),
+		 void (*print)(const char *buf, size_t len))
+{
+	unsigned int i, j, bits, last_bin, width;
+	struct skim_shard *shard;
+
+	memset(s, 0, sizeof(*s));
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	s->rate = rate;
+	s->block_len = block_len;
+	s->decode = decode;
+	s->print = print;
+	s->line_gap = blocks_per_dit * SKIM_LINE_GAP;
+
+	/* The FFT spans two blocks. The Hann window halves the
+	 * effective length again. */
+	for (s->fft_len = 2, bits = 1; s->fft_len < block_len * 2; bits++)
+		s->fft_len <<= 1;
+	s->first_bin = (SKIM_MIN_FREQ * s->fft_len + rate - 1) / rate;
+	last_bin = (rate / 2 - SKIM_MIN_FREQ) * s->fft_len / rate;
+	if (rate / 2 <= SKIM_MIN_FREQ * 2 || last_bin < s->first_bin)
+		return -1;
+	s->nr_bins = last_bin - s->first_bin + 1;
+
+	s->samples = calloc(s->fft_len, sizeof(*s->samples));
+	s->window = malloc(s->fft_len * sizeof(*s->window));
+	s->twiddle_re = malloc(s->fft_len / 2 * sizeof(*s->twiddle_re));
+	s->twiddle_im = malloc(s->fft_len / 2 * sizeof(*s->twiddle_im));
+	s->bitrev = malloc(s->fft_len * sizeof(*s->bitrev));
+	s->re = malloc(s->fft_len * sizeof(*s->re));
+	s->im = malloc(s->fft_len * sizeof(*s->im));
+	s->power = calloc((size_t)SKIM_ROWS * s->nr_bins, sizeof(*s->power));
+	s->floor = calloc(SKIM_ROWS, sizeof(*s->floor));
+	s->sorted = malloc(s->nr_bins * sizeof(*s->sorted));
+	s->noise = malloc(SKIM_BATCH * sizeof(*s->noise));
+	s->key = calloc(s->nr_bins, sizeof(*s->key));
+	s->channels = calloc(s->nr_bins, sizeof(*s->channels));
+	s->nr_shards = min(max(nr_threads, 1u), s->nr_bins);
+	s->shards = calloc(s->nr_shards, sizeof(*s->shards));
+	if (!s->samples || !s->window || !s->twiddle_re || !s->twiddle_im ||
+	    !s->bitrev || !s->re || !s->im || !s->power || !s->floor ||
+	    !s->sorted || !s->noise || !s->key || !s->channels || !s->shards)
+		goto error;
+
+	for (i = 0; i < s->fft_len; i++) {
+		s->window[i] = (float)(0.5 - 0.5 * cos(2.0 * PI * (double)i /
+						       (double)s->fft_len));
+		s->bitrev[i] = 0;
+		for (j = 0; j < bits; j++) {
+			if (i & (1u << j))
+				s->bitrev[i] |= 1u << (bits - 1 - j);
+		}
+	}
+	for (i = 0; i < s->fft_len / 2; i++) {
+		s->twiddle_re[i] = (float)cos(2.0 * PI * (double)i / (double)s->fft_len);
+		s->twiddle_im[i] = (float)-sin(2.0 * PI * (double)i / (double)s->fft_len);
+	}
+
+	for (i = 0; i < s->nr_bins; i++) {
+		s->channels[i].s = s;
+		key_decoder_init(&s->channels[i].keys, blocks_per_dit,
+				 skim_emit, &s->channels[i]);
+		/* Every sender has its own speed */
+		key_decoder_track(&s->channels[i].keys, blocks_per_dit / 2,
+				  blocks_per_dit * 4);
+	}
+
+	/* Split the bins into equal shards */
+	for (i = 0; i < s->nr_shards; i++) {
+		shard = &s->shards[i];
+		shard->s = s;
+		shard->first = (unsigned int)((uint64_t)s->nr_bins * i / s->nr_shards);
+		shard->end = (unsigned int)((uint64_t)s->nr_bins * (i + 1) / s->nr_shards);
+		width = shard->end - shard->first;
+		shard->level = malloc((size_t)SKIM_BATCH * (width + 2) * sizeof(*shard->level));
+		shard->keys = malloc((size_t)SKIM_BATCH * width * sizeof(*shard->keys));
+		if (!shard->level || !shard->keys)
+			goto error;
+	}
+	s->nr_rows = SKIM_HISTORY;
+
+	/* The workers live as long as the skimmer. If one can not be
+	 * started, the calling thread runs the rest of the shards. */
+	s->workers = calloc(s->nr_shards, sizeof(*s->workers));
+	if (!s->workers)
+		goto error;
+	for (i = 1; i < s->nr_shards; i++) {
+		if (pthread_create(&s->workers[i], NULL, skim_thread, &s->shards[i]))
+			break;
+		s->nr_workers++;
+	}
+
+	return 0;
+
+error:
+	skimmer_free(s);
+	return -1;
+}
+
+void skimmer_free(struct skimmer *s)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = true;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	for (i = 1; i <= s->nr_workers; i++)
+		pthread_join(s->workers[i], NULL);
+	free(s->workers);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+
+	if (s->channels) {
+		for (i = 0; i < s->nr_bins; i++)
+			free(s->channels[i].text);
+	}
+	if (s->shards) {
+		for (i = 0; i < s->nr_shards; i++) {
+			free(s->shards[i].level);
+			free(s->shards[i].keys);
+		}
+	}
+	free(s->samples);
+	free(s->window);
+	free(s->twiddle_re);
+	free(s->twiddle_im);
+	free(s->bitrev);
+	free(s->re);
+	free(s->im);
+	free(s->power);
+	free(s->floor);
+	free(s->sorted);
+	free(s->noise);
+	free(s->key);
+	free(s->channels);
+	free(s->shards);
+	memset(s, 0, sizeof(*s));
+}
+
+static void fft(struct skimmer *s)
+{
+	unsigned int n = s->fft_len, len, half, step, i, j, a, b;
+	float *re = s->re, *im = s->im, wr, wi, tr, ti;
+
+	for (len = 2; len <= n; len <<= 1) {
+		half = len / 2;
+		step = n / len;
+		for (i = 0; i < n; i += len) {
+			for (j = 0; j < half; j++) {
+				wr = s->twiddle_re[j * step];
+				wi = s->twiddle_im[j * step];
+				a = i + j;
+				b = a + half;
+				tr = re[b] * wr - im[b] * wi;
+				ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/* Find the k-th smallest value. Reorders the array. */
+static float select_float(float *v, int n, int k)
+{
+	int lo = 0, hi = n - 1, i, j;
+	float pivot, tmp;
+
+	while (lo < hi) {
+		pivot = v[lo + (hi - lo) / 2];
+		i = lo;
+		j = hi;
+		while (i <= j) {
+			while (v[i] < pivot)
+				i++;
+			while (v[j] > pivot)
+				j--;
+			if (i <= j) {
+				tmp = v[i];
+				v[i++] = v[j];
+				v[j--] = tmp;
+			}
+		}
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+
+	return v[k];
+}
+
+/* Transform the last fft_len samples into a new row of bin powers. */
+static void skim_frame(struct skimmer *s)
+{
+	float *row, scale, r, i;
+	unsigned int b, row_nr;
+
+	for (b = 0; b < s->fft_len; b++) {
+		s->re[s->bitrev[b]] = s->samples[b] * s->window[b];
+		s->im[b] = 0.0f;
+	}
+	fft(s);
+
+	row = &s->power[(size_t)s->nr_rows * s->nr_bins];
+	scale = 1.0f / ((float)s->fft_len * (float)s->fft_len);
+	for (b = 0; b < s->nr_bins; b++) {
+		r = s->re[s->first_bin + b];
+		i = s->im[s->first_bin + b];
+		/* Keep the levels above zero for digital silence. */
+		row[b] = (r * r + i * i) * scale + 1.0f;
+	}
+
+	/* Most bins carry no signal. The lower quartile
+	 * of the spectrum is the noise floor. */
+	memcpy(s->sorted, row, s->nr_bins * sizeof(*row));
+	s->floor[s->nr_rows] = select_float(s->sorted, (int)s->nr_bins,
+					    (int)s->nr_bins / 4);
+	if (!s->started) {
+		for (row_nr = 0; row_nr < s->nr_rows; row_nr++)
+			s->floor[row_nr] = s->floor[s->nr_rows];
+		s->started = true;
+	}
+	s->nr_rows++;
+}
+
+/* Decide nr_frames frames of the bins in one shard.
+ * Frame f is row f + SKIM_HISTORY. */
+static void skim_shard_run(struct skim_shard *shard, unsigned int nr_frames)
+{
+	struct skimmer *s = shard->s;
+	unsigned int width = shard->end - shard->first;
+	unsigned int f, k, c, lfirst, lend;
+	const float *src, *power;
+	float *level, sig, left, right, noise, p, t;
+	struct skim_channel *ch;
+	uint8_t *keys, on;
+
+	/* The signal level is the strongest power in the window.
+	 * The levels of the neighbour bins are needed as well, to find
+	 * the bin a signal is centered in. */
+	lfirst = shard->first ? shard->first - 1 : 0;
+	lend = min(shard->end + 1, s->nr_bins);
+	for (f = 0; f < nr_frames; f++) {
+		level = &shard->level[(size_t)f * (width + 2)];
+		memset(level, 0, (width + 2) * sizeof(*level));
+		level += lfirst + 1 - shard->first;
+		src = &s->power[(size_t)f * s->nr_bins + lfirst];
+		c = 0;
+#ifdef __SSE2__
+		for ( ; c + 4 <= lend - lfirst; c += 4) {
+			__m128 m = _mm_loadu_ps(&src[c]);
+
+			for (k = 1; k <= SKIM_WINDOW; k++)
+				m = _mm_max_ps(m, _mm_loadu_ps(&src[(size_t)k * s->nr_bins + c]));
+			_mm_storeu_ps(&level[c], m);
+		}
+#endif
+		for ( ; c < lend - lfirst; c++) {
+			level[c] = src[c];
+			for (k = 1; k <= SKIM_WINDOW; k++)
+				level[c] = max(level[c], src[(size_t)k * s->nr_bins + c]);
+		}
+	}
+
+	for (f = 0; f < nr_frames; f++) {
+		level = &shard->level[(size_t)f * (width + 2)];
+		power = &s->power[(size_t)(f + SKIM_HISTORY) * s->nr_bins + shard->first];
+		keys = &shard->keys[(size_t)f * width];
+		noise = s->noise[f];
+		for (c = 0; c < width; c++) {
+			left = level[c];
+			sig = level[c + 1];
+			right = level[c + 2];
+			p = power[c] * power[c];
+			t = sig * noise;
+			on = sig >= left && sig > right &&
+			     sig >= noise * SKIM_MIN_SNR;
+			if (s->key[shard->first + c])
+				on &= p * (SKIM_HYSTERESIS * SKIM_HYSTERESIS) > t;
+			else
+				on &= p > t * (SKIM_HYSTERESIS * SKIM_HYSTERESIS);
+			s->key[shard->first + c] = on;
+			keys[c] = on;
+		}
+	}
+
+	for (c = 0; c < width; c++) {
+		ch = &s->channels[shard->first + c];
+		for (f = 0; f < nr_frames; f++) {
+			key_decoder_sample(&ch->keys, shard->keys[(size_t)f * width + c]);
+			if (!ch->keys.key && ch->keys.run >= s->line_gap &&
+			    ch->len > ch->line)
+				skim_end_line(ch);
+		}
+	}
+}
+
+/* A shard worker. It runs its shard once per batch. */
+static void * skim_thread(void *arg)
+{
+	struct skim_shard *shard = arg;
+	struct skimmer *s = shard->s;
+	unsigned long batch = 0;
+	unsigned int nr_frames;
+
+	pthread_mutex_lock(&s->lock);
+	while (!s->stop) {
+		if (s->batch == batch) {
+			pthread_cond_wait(&s->cond, &s->lock);
+			continue;
+		}
+		batch = s->batch;
+		nr_frames = s->batch_frames;
+		pthread_mutex_unlock(&s->lock);
+
+		skim_shard_run(shard, nr_frames);
+
+		pthread_mutex_lock(&s->lock);
+		if (--s->busy == 0)
+			pthread_cond_broadcast(&s->cond);
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+/* Print the complete lines of all channels. */
+static void skim_print(struct skimmer *s)
+{
+	struct skim_channel *ch;
+	const char *line, *end;
+	unsigned int i;
+	char prefix[32];
+	int len;
+
+	for (i = 0; i < s->nr_bins; i++) {
+		ch = &s->channels[i];
+		if (!ch->line)
+			continue;
+		len = snprintf(prefix, sizeof(prefix), "%5u Hz: ",
+			       (unsigned int)(((uint64_t)(s->first_bin + i) * s->rate +
+					       s->fft_len / 2) / s->fft_len));
+		for (line = ch->text; line < ch->text + ch->line; line = end + 1) {
+			end = memchr(line, '\n', (size_t)(ch->text + ch->line - line));
+			s->print(prefix, (size_t)len);
+			s->print(line, (size_t)(end - line + 1));
+		}
+		memmove(ch->text, ch->text + ch->line, ch->len - ch->line);
+		ch->len -= ch->line;
+		ch->line = 0;
+	}
+}
+
+/* Decide the frames in the rows after the history.
+ * The rows up to nr_frames + SKIM_WINDOW must be filled. */
+static int skim_batch(struct skimmer *s, unsigned int nr_frames)
+{
+	unsigned int f, k, i;
+	float sum;
+	int err = 0;
+
+	/* Average the noise floor over the window */
+	for (f = 0; f < nr_frames; f++) {
+		sum = 0.0f;
+		for (k = 0; k <= SKIM_WINDOW; k++)
+			sum += s->floor[f + k];
+		s->noise[f] = sum / (float)(SKIM_WINDOW + 1);
+	}
+
+	/* The shards are independent. Run them in parallel. */
+	pthread_mutex_lock(&s->lock);
+	s->batch_frames = nr_frames;
+	s->busy = s->nr_workers;
+	s->batch++;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	skim_shard_run(&s->shards[0], nr_frames);
+	for (i = s->nr_workers + 1; i < s->nr_shards; i++)
+		skim_shard_run(&s->shards[i], nr_frames);
+	pthread_mutex_lock(&s->lock);
+	while (s->busy)
+		pthread_cond_wait(&s->cond, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+
+	for (i = 0; i < s->nr_bins; i++) {
+		if (s->channels[i].oom)
+			err = -1;
+	}
+	skim_print(s);
+
+	/* Keep the window of the next undecided frame */
+	memmove(s->power, &s->power[(size_t)nr_frames * s->nr_bins],
+		(size_t)SKIM_WINDOW * s->nr_bins * sizeof(*s->power));
+	memmove(s->floor, &s->floor[nr_frames],
+		SKIM_WINDOW * sizeof(*s->floor));
+	s->nr_rows -= nr_frames;
+
+	return err;
+}
+
+/* Feed 16 bit little endian samples into the skimmer. */
+int skimmer_run(struct skimmer *s, const char *pcm, size_t nr_samples)
+{
+	unsigned int offset = s->fft_len - s->block_len;
+	size_t i;
+
+	for (i = 0; i < nr_samples; i++) {
+		s->samples[offset + s->fill] = (float)(int16_t)get_le16(&pcm[i * 2]);
+		if (++s->fill < s->block_len)
+			continue;
+		skim_frame(s);
+		memmove(s->samples, &s->samples[s->block_len],
+			offset * sizeof(*s->samples));
+		s->fill = 0;
+		if (s->nr_rows == SKIM_ROWS) {
+			if (skim_batch(s, SKIM_BATCH))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Decide the remaining frames and print all text. */
+int skimmer_finish(struct skimmer *s)
+{
+	unsigned int nr_frames, i;
+	struct skim_channel *ch;
+
+	if (s->started) {
+		nr_frames = s->nr_rows - SKIM_HISTORY;
+		/* Pad the window after the last frame with silence */
+		memset(&s->power[(size_t)s->nr_rows * s->nr_bins], 0,
+		       (size_t)(SKIM_ROWS - s->nr_rows) * s->nr_bins * sizeof(*s->power));
+		for (i = s->nr_rows; i < SKIM_ROWS; i++)
+			s->floor[i] = s->floor[s->nr_rows - 1];
+		if (skim_batch(s, nr_frames))
+			return -1;
+	}
+	for (i = 0; i < s->nr_bins; i++) {
+		ch = &s->channels[i];
+		key_decoder_finish(&ch->keys);
+		if (ch->len > ch->line)
+			skim_end_line(ch);
+		if (ch->oom)
+			return -1;
+	}
+	skim_print(s);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#ifndef SKIMMER_H_
+#define SKIMMER_H_
+
+#include "util.h"
+#include "morse_encoder.h"
+#include "keying.h"
+
+#include <stddef.h>
+#include <pthread.h>
+
+
+/* One channel of the skimmer. That is one FFT bin. */
+struct skim_channel {
+	struct skimmer *s;
+	struct key_decoder keys;
+	/* Decoded text. Complete lines are terminated by '\n'. */
+	char *text;
+	size_t len;
+	size_t size;
+	/* The length of the complete lines */
+	size_t line;
+	/* Text was lost, because memory ran out */
+	bool oom;
+};
+
+/* The bins handled by one thread */
+struct skim_shard {
+	struct skimmer *s;
+	unsigned int first;
+	unsigned int end;
+	/* Signal levels of the bins first - 1 to end + 1 */
+	float *level;
+	/* Key decisions of the bins first to end */
+	uint8_t *keys;
+};
+
+/* Wideband multi signal decoder.
+ * The audio is split into FFT bins and every bin is decoded as
+ * a separate channel. The per frame data is stored as arrays of
+ * rows of all bins, so the per frame updates vectorize.
+ */
+struct skimmer {
+	unsigned int rate;
+	/* Frame advance and FFT length, in samples */
+	unsigned int block_len;
+	unsigned int fft_len;
+	/* The decoded bins */
+	unsigned int first_bin;
+	unsigned int nr_bins;
+	/* A gap of this many frames ends a line of text */
+	unsigned int line_gap;
+
+	/* The last fft_len input samples */
+	float *samples;
+	unsigned int fill;
+	/* FFT tables and work space */
+	float *window;
+	float *twiddle_re;
+	float *twiddle_im;
+	unsigned int *bitrev;
+	float *re;
+	float *im;
+
+	/* Bin powers of the frames. Rows of nr_bins. */
+	float *power;
+	/* Noise floor of the frames */
+	float *floor;
+	/* Work space for the noise floor */
+	float *sorted;
+	unsigned int nr_rows;
+	bool started;
+	/* Noise level around each frame of a batch */
+	float *noise;
+	/* The current key decisions */
+	uint8_t *key;
+
+	struct skim_channel *channels;
+	struct skim_shard *shards;
+	unsigned int nr_shards;
+
+	/* The shard workers. They run shards 1 to nr_workers.
+	 * The calling thread runs the other shards. */
+	pthread_t *workers;
+	unsigned int nr_workers;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* Sequence number of the current batch */
+	unsigned long batch;
+	unsigned int batch_frames;
+	/* Number of workers still running the current batch */
+	unsigned int busy;
+	bool stop;
+
+	/* Convert a symbol to a character */
+	char (*decode)(morse_sym_t sym);
+	/* Write out text */
+	void (*print)(const char *buf, size_t len);
+};
+
+int skimmer_init(struct skimmer *s, unsigned int rate,
+		 unsigned int block_len, unsigned int blocks_per_dit,
+		 unsigned int nr_threads,
+		 char (*decode)(morse_sym_t sym),
+		 void (*print)(const char *buf, size_t len));
+void skimmer_free(struct skimmer *s);
+int skimmer_run(struct skimmer *s, const char *pcm, size_t nr_samples);
+int skimmer_finish(struct skimmer *s);
+
+#endif /* SKIMMER_H_ */
@@ -7,6 +7,10 @@
 
 #define BUILD_BUG_ON(x)		((void)sizeof(char[1 - 2 * !!(x)]))
 
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+
 typedef _Bool		bool;
 #define true		((bool)(!!1))
 #define false		((bool)(!!0))
@@ -21,7 +21,8 @@
  *	LCD ausgegeben. Wird ein Symbol nicht erkannt, wird
  *	ein Fehlerzeichen ":(" auf dem LCD ausgegeben.
  *	Die Morsegeschwindigkeit wird ueber das Poti zwischen 1 und
- *	20 "Woertern pro Minute" (WpM) eingestellt.
+ *	20 "Woertern pro Minute" (WpM) eingestellt. Danach wird sie
+ *	automatisch der Geschwindigkeit des Senders nachgefuehrt.
  *
  * \section b Hardware
  *	myAVR Basisboard mit myAVR LCD Modul.
@@ -65,6 +66,7 @@
 #include "lcd.h"
 #include "morse.h"
 #include "buzzer.h"
+#include "../encoder/morse_speed.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -77,7 +79,7 @@
 /** Versionsnummer. */
 enum version_number {
 	VERSION_MAJOR	= 1,
-	VERSION_MINOR	= 1,
+	VERSION_MINOR	= 2,
 };
 
 /** Systemweite Parameter. */
@@ -138,6 +140,8 @@ struct symbol_capture_context {
 
 	/** Eingestellte "Wort pro Minute" Erkennungsgeschwindigkeit. */
 	uint8_t wpm;
+	/** Nachgefuehrte "dit" Laenge in "ticks". */
+	struct morse_speed speed;
 	/** Eingestellte "dit" Erkennungsgeschwindigkeit in "ticks". */
 	uint8_t ticks_dit;
 	/** Eingestellte "dah" Erkennungsgeschwindigkeit in "ticks". */
@@ -281,18 +285,15 @@ static void set_timings(uint8_t dit_base_ticks)
 	capture.ticks_inter_word = capture.ticks_dit * FACTOR_INTER_WORD;
 }
 
-/** \brief	Erkennungsgeschwindigkeit setzen.
+/** \brief	Laenge eines "dit" berechnen.
  *
- * \param wpm	Erkennungsgeschwindigkeit in "Words per minute".
- *		Ein Wort is definiert als 5 Morsezeichen.
+ * \param wpm	Geschwindigkeit in "Words per minute".
+ *
+ * \return	Gibt die Laenge eines "dit" Tones in "Ticks" zurueck.
  */
-static void set_words_per_minute(uint8_t wpm)
+static uint8_t wpm_to_dit_ticks(uint8_t wpm)
 {
 	uint32_t dit_len;
-	uint8_t dit_ticks, sreg;
-
-	/* WpM Bereich eingrenzen. */
-	wpm = clamp(wpm, MIN_WPM, MAX_WPM);
 
 	/* Laenge eines "dit" Tones in Mikrosekunden berechnen. */
 	dit_len = (uint32_t)DIT_LENGTH_1WPM_MS * 1000;
@@ -300,19 +301,53 @@ static void set_words_per_minute(uint8_t wpm)
 
 	/* Laenge eines "dit" Tones in "Ticks" umrechnen.
 	 * Rundungsfehler werden ignoriert. */
-	dit_ticks = dit_len / US_PER_TICK;
+	return dit_len / US_PER_TICK;
+}
+
+/** \brief	Erkennungsgeschwindigkeit setzen.
+ *
+ * Die Geschwindigkeitsnachfuehrung startet bei dieser Geschwindigkeit.
+ *
+ * \param wpm	Erkennungsgeschwindigkeit in "Words per minute".
+ *		Ein Wort is definiert als 5 Morsezeichen.
+ */
+static void set_words_per_minute(uint8_t wpm)
+{
+	uint8_t dit_ticks, sreg;
+
+	/* WpM Bereich eingrenzen. */
+	wpm = clamp(wpm, MIN_WPM, MAX_WPM);
+	dit_ticks = wpm_to_dit_ticks(wpm);
 
 	/* Wenn der WpM Wert vom aktuellen abweicht,
 	 * Symbolzeiten neu setzen. */
 	sreg = irq_disable_save();
 	if (wpm != capture.wpm) {
 		capture.wpm = wpm;
+		morse_speed_init(&capture.speed, dit_ticks,
+				 wpm_to_dit_ticks(MAX_WPM),
+				 wpm_to_dit_ticks(MIN_WPM));
 		set_timings(dit_ticks);
 		machine.async_lcd_update = 1;
 	}
 	irq_restore(sreg);
 }
 
+/** \brief	Erkennungstimings an die nachgefuehrte Geschwindigkeit anpassen.
+ *
+ * Wird im Interrupt aufgerufen.
+ */
+static void track_timings(void)
+{
+	uint8_t dit_ticks;
+
+	dit_ticks = morse_speed_dit(&capture.speed);
+	if (dit_ticks * FACTOR_DIT != capture.ticks_dit) {
+		set_timings(dit_ticks);
+		machine.async_lcd_update = 1;
+	}
+}
+
 /** \brief	Summer einschalten. */
 static void buzzer_turn_on(void)
 {
@@ -330,6 +365,7 @@ ISR(TIMER2_COMP_vect)
 {
 	enum edge_detect_result button_edge;
 	morse_sym_t new_mark;
+	uint8_t is_dah;
 	int8_t err;
 
 	mb();
@@ -349,16 +385,20 @@ ISR(TIMER2_COMP_vect)
 
 		/* Anhand der Tonlaenge entscheiden ob es ein "dit" oder
 		 * ein "dah" Ton war und den Ton zum aktuellen
-		 * Symbol hinzufuegen. */
+		 * Symbol hinzufuegen. Die Grenze liegt in der Mitte
+		 * zwischen "dit" und "dah". Die Tonlaenge fuehrt
+		 * die Geschwindigkeit nach. */
+		is_dah = morse_speed_mark(&capture.speed, capture.ticks);
 		if (capture.cur_mark_nr < MORSE_MAX_NR_MARKS) {
-			if (capture.ticks <= capture.ticks_dit)
-				new_mark = MORSE_MARK(MORSE_DIT, capture.cur_mark_nr);
-			else
+			if (is_dah)
 				new_mark = MORSE_MARK(MORSE_DAH, capture.cur_mark_nr);
+			else
+				new_mark = MORSE_MARK(MORSE_DIT, capture.cur_mark_nr);
 			capture.cur_symbol |= new_mark;
 			capture.cur_mark_nr++;
 		} else
 			capture.capture_error = 1;
+		track_timings();
 
 		/* Tonzaehler und Tonzustand ruecksetzen. */
 		capture.in_mark = 0;
@@ -371,6 +411,10 @@ ISR(TIMER2_COMP_vect)
 		/* Summer einschalten. */
 		buzzer_turn_on();
 
+		/* Die Pausenlaenge fuehrt die Geschwindigkeit nach. */
+		morse_speed_gap(&capture.speed, capture.ticks);
+		track_timings();
+
 		/* Tonzaehler ruecksetzen und Tonzustand setzen. */
 		capture.in_mark = 1;
 		capture.ticks = 0;
@@ -491,12 +535,17 @@ static void adc_init(void)
 /** \brief	Informationen auf LCD ausgeben. */
 static void update_lcd(void)
 {
+	uint16_t dit;
 	uint8_t wpm;
 
 	irq_disable();
-	wpm = capture.wpm;
+	dit = capture.speed.dit;
 	irq_enable();
 
+	/* Nachgefuehrte Geschwindigkeit in WpM umrechnen. */
+	wpm = ((uint32_t)DIT_LENGTH_1WPM_MS * 1000 << MORSE_SPEED_SHIFT) /
+	      ((uint32_t)dit * US_PER_TICK);
+
 	lcd_cursor(0, 0);
 	lcd_printf("mdec-%d.%d", VERSION_MAJOR, VERSION_MINOR);
 	lcd_cursor(0, 10);
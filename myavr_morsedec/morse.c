@@ -8,94 +8,36 @@
 #include "morse.h"
 #include "util.h"
 
+#include "../encoder/morse_alphabet.h"
 
-#define dit			MORSE_DIT
-#define dah			MORSE_DAH
 
-#define CHAR_SYM(charac, sym)	[(charac) - MORSE_CHARS_START] = sym
-#define NUM_SYM(num, sym)	[(num) - MORSE_NUMS_START] = sym
-#define SPEC_SYM(spec, sym)	[(spec) - MORSE_SPEC_START] = sym
-#define SIG_SYM(sig, sym)	[(sig) - MORSE_SIG_START] = sym
+#define CHAR_SYM(charac, sym)	[(charac) - MORSE_CHARS_START] = sym,
+#define NUM_SYM(num, sym)	[(num) - MORSE_NUMS_START] = sym,
+#define SPEC_SYM(spec, sym)	[(spec) - MORSE_SPEC_START] = sym,
+#define SIG_SYM(sig, sym)	[(sig) - MORSE_SIG_START] = sym,
 
 static const morse_sym_t PROGMEM character_symbols[] = {
-	CHAR_SYM(MORSE_A, MORSE_SYM_2(dit, dah)),
-	CHAR_SYM(MORSE_B, MORSE_SYM_4(dah, dit, dit, dit)),
-	CHAR_SYM(MORSE_C, MORSE_SYM_4(dah, dit, dah, dit)),
-	CHAR_SYM(MORSE_D, MORSE_SYM_3(dah, dit, dit)),
-	CHAR_SYM(MORSE_E, MORSE_SYM_1(dit)),
-	CHAR_SYM(MORSE_F, MORSE_SYM_4(dit, dit, dah, dit)),
-	CHAR_SYM(MORSE_G, MORSE_SYM_3(dah, dah, dit)),
-	CHAR_SYM(MORSE_H, MORSE_SYM_4(dit, dit, dit, dit)),
-	CHAR_SYM(MORSE_I, MORSE_SYM_2(dit, dit)),
-	CHAR_SYM(MORSE_J, MORSE_SYM_4(dit, dah, dah, dah)),
-	CHAR_SYM(MORSE_K, MORSE_SYM_3(dah, dit, dah)),
-	CHAR_SYM(MORSE_L, MORSE_SYM_4(dit, dah, dit, dit)),
-	CHAR_SYM(MORSE_M, MORSE_SYM_2(dah, dah)),
-	CHAR_SYM(MORSE_N, MORSE_SYM_2(dah, dit)),
-	CHAR_SYM(MORSE_O, MORSE_SYM_3(dah, dah, dah)),
-	CHAR_SYM(MORSE_P, MORSE_SYM_4(dit, dah, dah, dit)),
-	CHAR_SYM(MORSE_Q, MORSE_SYM_4(dah, dah, dit, dah)),
-	CHAR_SYM(MORSE_R, MORSE_SYM_3(dit, dah, dit)),
-	CHAR_SYM(MORSE_S, MORSE_SYM_3(dit, dit, dit)),
-	CHAR_SYM(MORSE_T, MORSE_SYM_1(dah)),
-	CHAR_SYM(MORSE_U, MORSE_SYM_3(dit, dit, dah)),
-	CHAR_SYM(MORSE_V, MORSE_SYM_4(dit, dit, dit, dah)),
-	CHAR_SYM(MORSE_W, MORSE_SYM_3(dit, dah, dah)),
-	CHAR_SYM(MORSE_X, MORSE_SYM_4(dah, dit, dit, dah)),
-	CHAR_SYM(MORSE_Y, MORSE_SYM_4(dah, dit, dah, dah)),
-	CHAR_SYM(MORSE_Z, MORSE_SYM_4(dah, dah, dit, dit)),
+	MORSE_ALPHABET_CHARACTERS(CHAR_SYM)
 };
 
 static const morse_sym_t PROGMEM number_symbols[] = {
-	NUM_SYM(MORSE_0, MORSE_SYM_5(dah, dah, dah, dah, dah)),
-	NUM_SYM(MORSE_1, MORSE_SYM_5(dit, dah, dah, dah, dah)),
-	NUM_SYM(MORSE_2, MORSE_SYM_5(dit, dit, dah, dah, dah)),
-	NUM_SYM(MORSE_3, MORSE_SYM_5(dit, dit, dit, dah, dah)),
-	NUM_SYM(MORSE_4, MORSE_SYM_5(dit, dit, dit, dit, dah)),
-	NUM_SYM(MORSE_5, MORSE_SYM_5(dit, dit, dit, dit, dit)),
-	NUM_SYM(MORSE_6, MORSE_SYM_5(dah, dit, dit, dit, dit)),
-	NUM_SYM(MORSE_7, MORSE_SYM_5(dah, dah, dit, dit, dit)),
-	NUM_SYM(MORSE_8, MORSE_SYM_5(dah, dah, dah, dit, dit)),
-	NUM_SYM(MORSE_9, MORSE_SYM_5(dah, dah, dah, dah, dit)),
+	MORSE_ALPHABET_NUMBERS(NUM_SYM)
 };
 
 static const morse_sym_t PROGMEM special_symbols[] = {
-	SPEC_SYM(MORSE_GACC_A, MORSE_SYM_5(dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_AE, MORSE_SYM_4(dit, dah, dit, dah)),
-	SPEC_SYM(MORSE_GACC_E, MORSE_SYM_5(dit, dah, dit, dit, dah)),
-	SPEC_SYM(MORSE_AACC_E, MORSE_SYM_5(dit, dit, dah, dit, dit)),
-	SPEC_SYM(MORSE_OE, MORSE_SYM_4(dah, dah, dah, dit)),
-	SPEC_SYM(MORSE_UE, MORSE_SYM_4(dit, dit, dah, dah)),
-	SPEC_SYM(MORSE_SZ, MORSE_SYM_6(dit, dit, dit, dah, dah, dit)),
-	SPEC_SYM(MORSE_CH, MORSE_SYM_4(dah, dah, dah, dah)),
-	SPEC_SYM(MORSE_TILDE_N, MORSE_SYM_5(dah, dah, dit, dah, dah)),
-	SPEC_SYM(MORSE_PERIOD, MORSE_SYM_6(dit, dah, dit, dah, dit, dah)),
-	SPEC_SYM(MORSE_COMMA, MORSE_SYM_6(dah, dah, dit, dit, dah, dah)),
-	SPEC_SYM(MORSE_COLON, MORSE_SYM_6(dah, dah, dah, dit, dit, dit)),
-	SPEC_SYM(MORSE_SEMICOLON, MORSE_SYM_6(dah, dit, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_QUESTION, MORSE_SYM_6(dit, dit, dah, dah, dit, dit)),
-	SPEC_SYM(MORSE_DASH, MORSE_SYM_6(dah, dit, dit, dit, dit, dah)),
-	SPEC_SYM(MORSE_UNDERSCORE, MORSE_SYM_6(dit, dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_PAREN_OPEN, MORSE_SYM_5(dah, dit, dah, dah, dit)),
-	SPEC_SYM(MORSE_PAREN_CLOSE, MORSE_SYM_6(dah, dit, dah, dah, dit, dah)),
-	SPEC_SYM(MORSE_TICK, MORSE_SYM_6(dit, dah, dah, dah, dah, dit)),
-	SPEC_SYM(MORSE_EQUAL, MORSE_SYM_5(dah, dit, dit, dit, dah)),
-	SPEC_SYM(MORSE_PLUS, MORSE_SYM_5(dit, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_SLASH, MORSE_SYM_5(dah, dit, dit, dah, dit)),
-	SPEC_SYM(MORSE_AT, MORSE_SYM_6(dit, dah, dah, dit, dah, dit)),
-	SPEC_SYM(MORSE_SPACE, 0),
+	MORSE_ALPHABET_SPECIALS(SPEC_SYM)
 };
 
 static const morse_sym_t PROGMEM signal_symbols[] = {
-	SIG_SYM(MORSE_SIG_KA, MORSE_SYM_5(dah, dit, dah, dit, dah)),
-	SIG_SYM(MORSE_SIG_BT, MORSE_SYM_5(dah, dit, dit, dit, dah)),
-	SIG_SYM(MORSE_SIG_AR, MORSE_SYM_5(dit, dah, dit, dah, dit)),
-	SIG_SYM(MORSE_SIG_VE, MORSE_SYM_5(dit, dit, dit, dah, dit)),
-	SIG_SYM(MORSE_SIG_SK, MORSE_SYM_6(dit, dit, dit, dah, dit, dah)),
-	SIG_SYM(MORSE_SIG_SOS, MORSE_SYM_9(dit, dit, dit, dah, dah, dah, dit, dit, dit)),
-	SIG_SYM(MORSE_SIG_ERROR, MORSE_SYM_8(dit, dit, dit, dit, dit, dit, dit, dit)),
+	MORSE_ALPHABET_SIGNALS(SIG_SYM)
 };
 
+/* ASCII -> morse symbol. Use MORSE_ASCII_TAB_SYM() to read entries. */
+static const morse_sym_t PROGMEM ascii_symbols[256] = MORSE_ASCII_TAB_INIT;
+
+/* Reverse lookup: MORSE_SYM_INDEX(sym) -> enum morse_character */
+static const uint8_t PROGMEM decode_symbols[MORSE_NR_SYM_INDEXES] = MORSE_DECODE_TAB_INIT;
+
 
 static morse_sym_t fetch_sym(const morse_sym_t * PROGPTR table,
 			     uint8_t offset)
@@ -117,24 +59,20 @@ morse_sym_t morse_encode_character(enum morse_character c)
 	return fetch_sym(signal_symbols, MORSE_SIG_ERROR - MORSE_SIG_START);
 }
 
-enum morse_character morse_decode_symbol(morse_sym_t sym)
+morse_sym_t morse_encode_ascii(char c)
 {
-	unsigned int i;
-
-#define check_decode_tab(table, startchar)				\
-	for (i = 0; i < ARRAY_SIZE(table); i++) {			\
-		if (fetch_sym(table, i) == sym)				\
-			return (enum morse_character)(i + startchar);	\
-	}
+	return MORSE_ASCII_TAB_SYM(pgm_read_word(&ascii_symbols[(uint8_t)c]));
+}
 
-	check_decode_tab(character_symbols, MORSE_CHARS_START)
-	check_decode_tab(number_symbols, MORSE_NUMS_START)
-	check_decode_tab(special_symbols, MORSE_SPEC_START)
-	check_decode_tab(signal_symbols, MORSE_SIG_START)
+enum morse_character morse_decode_symbol(morse_sym_t sym)
+{
+	uint8_t size = morse_sym_size(sym);
 
-#undef check_decode_tab
+	/* Marks above the symbol size would alias another table entry. */
+	if (size > MORSE_MAX_NR_MARKS || ((sym & 0x0FFF) >> size))
+		return MORSE_INVALID;
 
-	return MORSE_INVALID;
+	return (enum morse_character)pgm_read_byte(&decode_symbols[MORSE_SYM_INDEX(sym)]);
 }
 
 int8_t morse_to_ascii(char *buf, uint8_t buf_size,
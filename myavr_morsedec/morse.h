@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 
+#include "../encoder/morse_timing.h"
 
 /* Low level morse symbols */
 enum morse_marks {
@@ -152,21 +153,10 @@ enum morse_character {
 	MORSE_SIG_END		= MORSE_SIG_ERROR,
 };
 
-/* Morse factors - In multiples of "dit" */
-enum morse_factors {
-	FACTOR_DIT		= 1,
-	FACTOR_DAH		= 3,
-	FACTOR_INTER_MARK	= 1,
-	FACTOR_INTER_CHAR	= 3,
-	FACTOR_INTER_WORD	= 7,
-};
-
-/* Length of one "dit" in milliseconds at a rate
- * of one word per minute. */
-#define DIT_LENGTH_1WPM_MS	1200
-
 
 morse_sym_t morse_encode_character(enum morse_character mchar);
+/* Returns 0xFFFF (MORSE_SYM_INVALID) for characters that can't be encoded. */
+morse_sym_t morse_encode_ascii(char c);
 enum morse_character morse_decode_symbol(morse_sym_t sym);
 int8_t morse_to_ascii(char *buf, uint8_t buf_size,
 		      enum morse_character mchar);
@@ -20,23 +20,28 @@
 
 #include "util.h"
 
-#include <util/delay.h>
-
 #include <avr/sleep.h>
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
+#include <avr/wdt.h>
 
 #include "../encoder/morse_encoder.h"
 
 
-/* Beeper connection */
+/* Beeper connection. This must be OC0A. Timer0 generates the tone. */
 #define MORSE_BEEPER_PORT	PORTB
 #define MORSE_BEEPER_DDR	DDRB
 #define MORSE_BEEPER_BIT	0
 
 
-/* The morse symbols, in EEPROM. */
-static const morse_sym_t EEMEM morse_symbols[32];
+/* The message, in EEPROM. A packed bitstream, as written by
+ * morse_encoder -P. Every symbol is a 4 bit size followed by its marks,
+ * least significant bit first. Size 0 is a space between words.
+ * Size 15 terminates the message. */
+static const uint8_t EEMEM morse_message[E2END + 1];
+
+#define PACKED_SIZE_BITS	4
+#define PACKED_END		0xF
 
 
 /* Beeper context */
@@ -44,30 +49,62 @@ enum {
 	BEEPER_STOPPED,
 	BEEPER_NEXTSYM,
 	BEEPER_INSYM,
+	BEEPER_INMARK,
 };
 static uint8_t beeper_state;
-static uint16_t timer;
-static uint16_t counter;
-static uint8_t morse_sym_ptr;		/* Symbol pointer */
-static uint8_t morse_sym_size;		/* Size of the current symbol */
-static uint16_t morse_sym_marks;	/* The marks of the current symbol */
-
-#define TIMER_INBEEP		1
-#define TIMER_DIT		(TIMER_INBEEP * 240)
+static uint8_t timer;
+static uint8_t morse_byte_ptr;		/* Next message byte */
+static uint8_t morse_bits;		/* Unread bits of the current byte */
+static uint8_t morse_nr_bits;		/* Number of unread bits */
+static uint8_t morse_sym_size;		/* Marks left in the current symbol */
+
+/* The timer counts watchdog ticks. Every key-up and key-down happens
+ * right after a tick. No other ticks are taken. */
+#define TIMER_DIT		1	/* 125 ms */
 #define TIMER_DAH		(TIMER_DIT * 3)
 #define TIMER_INTERMARK		(TIMER_DIT * 1)
 #define TIMER_INTERCHAR		(TIMER_DIT * 3)
 #define TIMER_INTERWORD		(TIMER_DIT * 7)
 
+/* Button debouncing.
+ * A press acts at once. Then INT0 is disabled, until the watchdog tick
+ * has seen the button released for BUTTON_DEBOUNCE ticks in a row. */
+#define BUTTON_DEBOUNCE		2	/* 125 to 250 ms */
+static uint8_t button_debounce;		/* Ticks left. 0 if INT0 is enabled */
+
 
-/* 2 kHz trigger frequency */
-ISR(TIM0_COMPA_vect)
+static inline uint8_t int0_triggered(void)
+{
+	return !(PINB & (1 << 1));
+}
+
+static inline void wdt_irq_enable(void)
+{
+	WDTCR |= (1 << WDTIE);
+}
+
+static inline void wdt_irq_disable(void)
+{
+	WDTCR &= ~(1 << WDTIE);
+}
+
+/* 8 Hz trigger frequency. Only enabled while playing or debouncing.
+ * The watchdog keeps running in power down. */
+ISR(WDT_vect)
 {
 	if (timer)
 		timer--;
+	if (button_debounce) {
+		if (int0_triggered())
+			button_debounce = BUTTON_DEBOUNCE;
+		else if (--button_debounce == 0)
+			GIMSK |= (1 << INT0);
+	}
+	if (beeper_state == BEEPER_STOPPED && !button_debounce)
+		wdt_irq_disable();
 }
 
-static inline void timer_set(uint16_t value)
+static inline void timer_set(uint8_t value)
 {
 	timer = value;
 }
@@ -77,32 +114,55 @@ static inline uint8_t timer_running(void)
 	return (timer != 0);
 }
 
+/* The watchdog is the time base. It runs in interrupt mode,
+ * so it never resets the device. */
 static void timer_init(void)
+{
+	wdt_reset();
+	WDTCR = (1 << WDCE) | (1 << WDE);
+	WDTCR = (1 << WDP1) | (1 << WDP0); /* 125 ms, IRQ disabled */
+}
+
+/* Timer0 toggles OC0A on compare match. That is a 960 Hz tone.
+ * The CPU is not involved, but the timer clock stops in power down. */
+static void tone_init(void)
 {
 	TCCR0B = 0; /* Disable */
-	TIFR0 |= (1 << OCF0A);
-	TIMSK0 |= (1 << OCIE0A); /* Enable compA IRQ */
+	TIMSK0 = 0;
 	TCNT0 = 0;
 	OCR0A = 38;
-	TCCR0A = (1 << WGM01); /* CTC */
+	TCCR0A = (1 << WGM01); /* CTC, OC0A disconnected */
+}
+
+static void tone_on(void)
+{
+	TCNT0 = 0;
+	TCCR0A = (1 << COM0A0) | (1 << WGM01); /* Toggle OC0A */
 	TCCR0B = (0 << CS02) | (1 << CS01) | (1 << CS00); /* prescaler 64 */
 }
 
+static void tone_off(void)
+{
+	TCCR0B = 0;
+	/* The pin falls back to the PORTB bit, which is low. */
+	TCCR0A = (1 << WGM01);
+}
+
 static void beeper_startup(void)
 {
 	beeper_state = BEEPER_NEXTSYM;
-	morse_sym_ptr = 0;
+	morse_byte_ptr = 0;
+	morse_nr_bits = 0;
+	timer_set(0);
+	/* Start a fresh watchdog period for the first mark */
+	wdt_reset();
+	wdt_irq_enable();
 }
 
 static void beeper_stop(void)
 {
 	beeper_state = BEEPER_STOPPED;
-	MORSE_BEEPER_PORT &= ~(1 << MORSE_BEEPER_BIT);
-}
-
-static inline uint8_t int0_triggered(void)
-{
-	return !(PINB & (1 << 1));
+	tone_off();
 }
 
 ISR(INT0_vect)
@@ -111,68 +171,78 @@ ISR(INT0_vect)
 		beeper_startup();
 	else
 		beeper_stop();
-	while (1) {
-		while (int0_triggered())
-			; /* Wait for release */
-		_delay_ms(50);
-		if (!int0_triggered())
-			break;
+	/* Ignore the button until it is released. See WDT_vect. */
+	GIMSK &= ~(1 << INT0);
+	button_debounce = BUTTON_DEBOUNCE;
+	wdt_irq_enable();
+}
+
+/* Read the next count (at most 8) bits of the message.
+ * Beyond the end of the EEPROM, all bits are 1. That is a terminator. */
+static uint8_t packed_read(uint8_t count)
+{
+	uint8_t value = 0, mask = 1;
+
+	while (count--) {
+		if (!morse_nr_bits) {
+			if (morse_byte_ptr < ARRAY_SIZE(morse_message))
+				morse_bits = eeprom_read_byte(&morse_message[morse_byte_ptr++]);
+			else
+				morse_bits = 0xFF;
+			morse_nr_bits = 8;
+		}
+		if (morse_bits & 1)
+			value |= mask;
+		morse_bits >>= 1;
+		morse_nr_bits--;
+		mask <<= 1;
 	}
+
+	return value;
 }
 
-/* Runs with IRQs disabled. */
+/* Runs with IRQs disabled.
+ * Does one key-up or key-down, when the timer expired. */
 static void run_beeper(void)
 {
-	morse_sym_t sym;
+	uint8_t size;
 
 	if (timer_running())
 		return; /* delay */
 
 	switch (beeper_state) {
 	case BEEPER_NEXTSYM:
-		if (morse_sym_ptr >= ARRAY_SIZE(morse_symbols)) {
-			beeper_stop();
-			return;
-		}
-		sym = eeprom_read_word(&morse_symbols[morse_sym_ptr]);
-		if (sym == 0xFFFF) {
+		size = packed_read(PACKED_SIZE_BITS);
+		if (size == PACKED_END) {
 			beeper_stop();
 			return;
 		}
-		morse_sym_ptr++;
-		if (MORSE_SYM_IS_SPACE(sym)) {
+		if (size == 0) { /* Space between words */
 			timer_set(TIMER_INTERWORD);
 			return;
 		}
-		morse_sym_marks = MORSE_SYM_MARKS(sym);
-		morse_sym_size = MORSE_SYM_SIZE(sym);
+		/* The marks are read one by one, while playing. */
+		morse_sym_size = size;
 		beeper_state = BEEPER_INSYM;
-		timer_set(TIMER_INBEEP);
-		counter = 0;
 		/* fallthrough */
 	case BEEPER_INSYM:
-		if (counter == 0) {
-			if (!morse_sym_size) {
-				beeper_state = BEEPER_NEXTSYM;
-				timer_set(TIMER_INTERCHAR);
-				return;
-			}
-			if ((morse_sym_marks & 1) == MORSE_DIT)
-				counter = TIMER_DIT;
-			else /* dah */
-				counter = TIMER_DAH;
-			morse_sym_size--;
-			morse_sym_marks >>= 1;
-		} else {
-			counter--;
-			if (counter == 0) {
-				timer_set(TIMER_INTERMARK);
-				MORSE_BEEPER_PORT &= ~(1 << MORSE_BEEPER_BIT);
-				return;
-			}
+		if (!morse_sym_size) {
+			beeper_state = BEEPER_NEXTSYM;
+			timer_set(TIMER_INTERCHAR);
+			return;
 		}
-		MORSE_BEEPER_PORT ^= (1 << MORSE_BEEPER_BIT);
-		timer_set(TIMER_INBEEP);
+		if (packed_read(1) == MORSE_DIT)
+			timer_set(TIMER_DIT);
+		else /* dah */
+			timer_set(TIMER_DAH);
+		morse_sym_size--;
+		beeper_state = BEEPER_INMARK;
+		tone_on();
+		break;
+	case BEEPER_INMARK:
+		beeper_state = BEEPER_INSYM;
+		timer_set(TIMER_INTERMARK);
+		tone_off();
 		break;
 	}
 }
@@ -194,15 +264,17 @@ int main(void)
 	GIMSK |= (1 << INT0);
 
 	timer_init();
+	tone_init();
 
-	set_sleep_mode(SLEEP_MODE_IDLE);
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
 	sleep_enable();
 	while (1) {
 		mb();
-		if (beeper_state == BEEPER_STOPPED)
-			set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-		else
+		/* The tone needs the Timer0 clock. It stops in power down. */
+		if (beeper_state == BEEPER_INMARK)
 			set_sleep_mode(SLEEP_MODE_IDLE);
+		else
+			set_sleep_mode(SLEEP_MODE_PWR_DOWN);
 		irq_enable();
 		sleep_cpu();
 		irq_disable();